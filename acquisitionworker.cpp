@@ -0,0 +1,123 @@
+#include "acquisitionworker.h"
+
+#include <chrono>
+
+AcquisitionWorker::AcquisitionWorker(int intervalMs)
+    : mIntervalMs(intervalMs > 0 ? intervalMs : DEFAULT_INTERVAL_MS)
+{
+}
+
+AcquisitionWorker::~AcquisitionWorker()
+{
+    stop();
+}
+
+void AcquisitionWorker::setInterval(int intervalMs)
+{
+    mIntervalMs = intervalMs > 0 ? intervalMs : DEFAULT_INTERVAL_MS;
+    mCond.notify_one();
+}
+
+void AcquisitionWorker::start(PollFunc poll)
+{
+    stop();
+    // 丢弃上一次采集遗留的快照
+    mSnapshots.update();
+    mPoll = std::move(poll);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = false;
+    }
+    mThread = std::make_unique<std::thread>(&AcquisitionWorker::run, this);
+}
+
+void AcquisitionWorker::stop()
+{
+    if (!mThread)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = true;
+    }
+    mCond.notify_one();
+    mThread->join();
+    mThread.reset();
+    mPoll = nullptr;
+
+    // 线程退出前没来得及执行的写操作
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        tasks.swap(mTasks);
+    }
+    for (auto &task : tasks)
+    {
+        task();
+    }
+}
+
+void AcquisitionWorker::post(std::function<void()> task)
+{
+    if (!mThread)
+    {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTasks.emplace_back(std::move(task));
+    }
+    mCond.notify_one();
+}
+
+const AcquisitionWorker::Snapshot *AcquisitionWorker::latest()
+{
+    return mSnapshots.update() ? &mSnapshots.front() : nullptr;
+}
+
+void AcquisitionWorker::run()
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point next = Clock::now();
+    uint64_t seq = 0;
+    std::vector<std::function<void()>> tasks;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mCond.wait_until(lock, next, [this]
+                             { return mFinish || !mTasks.empty(); });
+            if (mFinish)
+            {
+                break;
+            }
+            tasks.swap(mTasks);
+        }
+        for (auto &task : tasks)
+        {
+            task();
+        }
+        tasks.clear();
+
+        Clock::time_point now = Clock::now();
+        if (now < next)
+        {
+            continue;
+        }
+
+        Snapshot &snap = mSnapshots.back();
+        snap.connected = mPoll(snap.values);
+        snap.seq = ++seq;
+        mSnapshots.publish();
+
+        // 轮询本身超过周期时不追赶, 从当前时刻重新计时
+        next += std::chrono::milliseconds(mIntervalMs.load());
+        if (next < now)
+        {
+            next = now + std::chrono::milliseconds(mIntervalMs.load());
+        }
+    }
+}
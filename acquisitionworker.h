@@ -0,0 +1,62 @@
+#ifndef ACQUISITIONWORKER_H
+#define ACQUISITIONWORKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "triplebuffer.h"
+
+// 采集线程: 按固定周期轮询设备, 通过三缓冲发布快照, 界面线程只取最新一份,
+// 轮询速率与界面刷新速率互不影响, 慢从站也不会卡住界面.
+class AcquisitionWorker
+{
+public:
+    struct Snapshot
+    {
+        std::vector<uint16_t> values;
+        bool connected = true;
+        uint64_t seq = 0;
+    };
+    // 在采集线程中调用, 把读到的值写入values, 返回连接是否仍然有效
+    using PollFunc = std::function<bool(std::vector<uint16_t> &values)>;
+
+    static constexpr int DEFAULT_INTERVAL_MS = 50;
+
+    explicit AcquisitionWorker(int intervalMs = DEFAULT_INTERVAL_MS);
+    ~AcquisitionWorker();
+
+    void setInterval(int intervalMs);
+    int interval() const { return mIntervalMs; }
+
+    void start(PollFunc poll);
+    void stop();
+    bool running() const { return mThread != nullptr; }
+
+    // 在采集线程中执行, 用于和轮询共用同一连接的写操作; 未运行时直接在调用线程执行
+    void post(std::function<void()> task);
+
+    // 界面线程调用: 有新快照时返回它, 否则返回nullptr
+    const Snapshot *latest();
+
+private:
+    std::atomic<int> mIntervalMs;
+    PollFunc mPoll;
+    std::unique_ptr<std::thread> mThread;
+    TripleBuffer<Snapshot> mSnapshots;
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::vector<std::function<void()>> mTasks;
+    bool mFinish = false;
+
+private:
+    void run();
+};
+
+#endif // ACQUISITIONWORKER_H
@@ -0,0 +1,255 @@
+#include "headless.h"
+#include "platform.h"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+
+namespace
+{
+std::atomic<bool> gStop{false};
+// 网关统计的打印周期, 以exec的200ms节拍计
+constexpr int STATS_PERIOD_TICKS = 50;
+
+void onSignal(int)
+{
+    gStop = true;
+}
+
+ModbusSlave::RegisterInfo registerInfo(const HeadlessSimulator::RegisterConfig &hold,
+                                       const HeadlessSimulator::RegisterConfig &input)
+{
+    ModbusSlave::RegisterInfo info{0, 0, 0, 0};
+    info.holdRegister.addr = hold.addr;
+    info.holdRegister.size = hold.size;
+    info.inputRegister.addr = input.addr;
+    info.inputRegister.size = input.size;
+    return info;
+}
+
+void addWindows(ModbusSlave &slave, ModbusSlave::AddrType type, const HeadlessSimulator::RegisterConfig &conf,
+                int unitId = -1)
+{
+    for (const auto &window : conf.windows)
+    {
+        slave.addRegisterWindow(type, window.first, window.second, unitId);
+    }
+}
+
+void writeInitial(const std::shared_ptr<RegisterBank> &bank, const HeadlessSimulator::RegisterConfig &conf)
+{
+    if (bank && !conf.values.empty())
+    {
+        bank->write(conf.addr, conf.values);
+    }
+}
+}
+
+HeadlessSimulator::~HeadlessSimulator()
+{
+    close();
+}
+
+int HeadlessSimulator::open(const Config &config)
+{
+    platform::raiseFileLimit();
+
+    if (ModbusTcpReactor::supported())
+    {
+        mReactor = std::make_shared<ModbusTcpReactor>(config.reactorThreads);
+        mReactor->setMaxConnections(config.maxConnections);
+        if (!mReactor->start())
+        {
+            mReactor.reset();
+        }
+    }
+
+    for (const SlaveConfig &conf : config.slaves)
+    {
+        if (conf.type == SlaveConfig::Type::GATEWAY)
+        {
+            auto gateway = std::make_unique<ModbusGateway>();
+            gateway->setLocalPort(conf.ip, conf.port);
+            gateway->setTarget(conf.device, conf.baud, conf.parity, conf.dataBits, conf.stopBits);
+            gateway->setResponseTimeout(conf.responseTimeoutMs);
+            gateway->setQueueLimit(conf.queueLimit);
+            if (!gateway->open())
+            {
+                Log("Failed to open gateway", conf.ip + ":" + std::to_string(conf.port) + " -> " + conf.device);
+                continue;
+            }
+            mGateways.push_back(std::move(gateway));
+            continue;
+        }
+        int count = conf.type == SlaveConfig::Type::TCP ? conf.count : 1;
+        for (int i = 0; i < count; i++)
+        {
+            std::shared_ptr<ModbusSlave> slave;
+            std::shared_ptr<ModbusSlaveRTU> rtu;
+            if (conf.type == SlaveConfig::Type::TCP)
+            {
+                auto tcp = std::make_shared<ModbusSlaveTCP>();
+                tcp->setLocalPort(conf.ip, conf.port + i);
+                tcp->setClientLimits(conf.maxClients, conf.idleTimeoutMs);
+                if (mReactor)
+                {
+                    tcp->setReactor(mReactor);
+                }
+                slave = tcp;
+            }
+            else
+            {
+                rtu = std::make_shared<ModbusSlaveRTU>();
+                rtu->setTarget(conf.device, conf.baud, conf.parity, conf.dataBits, conf.stopBits);
+#if !defined(_WIN32)
+                if (conf.virtualBus)
+                {
+                    rtu->setVirtualBus(conf.device);
+                }
+#endif
+                slave = rtu;
+            }
+            slave->setSlave(conf.slaveId);
+            if (conf.holdRegister.size > 0 || conf.inputRegister.size > 0 || conf.units.empty())
+            {
+                slave->createRegisterMapping(registerInfo(conf.holdRegister, conf.inputRegister));
+            }
+            addWindows(*slave, ModbusSlave::AddrType::HOLD_REGISTER, conf.holdRegister);
+            addWindows(*slave, ModbusSlave::AddrType::INPUT_REGISTER, conf.inputRegister);
+            if (!conf.sharedMemory.empty())
+            {
+                std::string name = conf.count > 1 ? conf.sharedMemory + "_" + std::to_string(i) : conf.sharedMemory;
+                if (!slave->shareRegisters(name, conf.sharedMemoryMode))
+                {
+                    Log("Failed to map shared memory", name);
+                }
+            }
+            for (const UnitConfig &unit : conf.units)
+            {
+                slave->addUnit(unit.unitId, registerInfo(unit.holdRegister, unit.inputRegister));
+                addWindows(*slave, ModbusSlave::AddrType::HOLD_REGISTER, unit.holdRegister, unit.unitId);
+                addWindows(*slave, ModbusSlave::AddrType::INPUT_REGISTER, unit.inputRegister, unit.unitId);
+            }
+            if (!slave->open())
+            {
+                if (conf.type == SlaveConfig::Type::TCP)
+                {
+                    Log("Failed to listen on", conf.ip + ":" + std::to_string(conf.port + i));
+                }
+                else
+                {
+                    Log("Failed to open", conf.virtualBus ? "virtual bus " + conf.device : conf.device);
+                }
+                continue;
+            }
+#if !defined(_WIN32)
+            if (rtu && conf.virtualBus)
+            {
+                Log("Virtual bus on", rtu->busPort() + (conf.device.empty() ? "" : " (" + conf.device + ")"));
+            }
+#endif
+            if (!conf.holdRegister.values.empty())
+            {
+                slave->writeHoldRegister(conf.holdRegister.addr, conf.holdRegister.values);
+            }
+            if (!conf.inputRegister.values.empty())
+            {
+                slave->writeInputRegister(conf.inputRegister.addr, conf.inputRegister.values);
+            }
+            for (const UnitConfig &unit : conf.units)
+            {
+                writeInitial(slave->unitBank(unit.unitId, ModbusSlave::AddrType::HOLD_REGISTER), unit.holdRegister);
+                writeInitial(slave->unitBank(unit.unitId, ModbusSlave::AddrType::INPUT_REGISTER), unit.inputRegister);
+            }
+            for (const SignalConfig &signal : conf.signals)
+            {
+                if (!mSignals)
+                {
+                    mSignals = std::make_unique<SignalEngine>(config.signalRateHz);
+                }
+                if (mSignals->addSignal(slave->unitBank(signal.unitId, signal.type), signal.signal) < 0)
+                {
+                    Log("Invalid signal at address", signal.signal.addr);
+                }
+            }
+            mSlaves.push_back(slave);
+        }
+    }
+    if (mSignals && !mSignals->start())
+    {
+        Log("Signals overlap, generator not started");
+    }
+    return static_cast<int>(mSlaves.size() + mGateways.size());
+}
+
+void HeadlessSimulator::close()
+{
+    mSignals.reset();
+    // 网关可能转发到本进程的虚拟总线上, 先于从站关闭
+    mGateways.clear();
+    for (auto &slave : mSlaves)
+    {
+        slave->close();
+    }
+    mSlaves.clear();
+    if (mReactor)
+    {
+        mReactor->stop();
+        mReactor.reset();
+    }
+}
+
+void HeadlessSimulator::logGatewayStats() const
+{
+    for (size_t i = 0; i < mGateways.size(); i++)
+    {
+        ModbusGateway::Stats st = mGateways[i]->stats();
+        uint64_t answered = std::max<uint64_t>(1, st.requests - st.rejected);
+        uint64_t transactions = std::max<uint64_t>(1, st.transactions);
+        Log("Gateway " + std::to_string(i), "requests=" + std::to_string(st.requests),
+            "transactions=" + std::to_string(st.transactions), "coalesced=" + std::to_string(st.coalesced),
+            "timeouts=" + std::to_string(st.timeouts), "rejected=" + std::to_string(st.rejected),
+            "avgQueueUs=" + std::to_string(st.queueWaitUs / answered),
+            "maxQueueUs=" + std::to_string(st.maxQueueWaitUs), "avgBusUs=" + std::to_string(st.busTimeUs / transactions));
+    }
+}
+
+void HeadlessSimulator::exec()
+{
+    gStop = false;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    int ticks = 0;
+    while (!gStop)
+    {
+        platform::sleepMs(200);
+        if (++ticks % STATS_PERIOD_TICKS == 0)
+        {
+            logGatewayStats();
+        }
+    }
+}
+
+int runHeadless(const std::string &configPath)
+{
+    HeadlessSimulator::Config config;
+    std::string error;
+    if (!HeadlessSimulator::loadConfig(configPath, config, error))
+    {
+        Log("Invalid config:", error);
+        return 1;
+    }
+
+    HeadlessSimulator simulator;
+    int opened = simulator.open(config);
+    if (opened == 0)
+    {
+        Log("No slave opened.");
+        return 1;
+    }
+    Log("Slaves running:", opened);
+    simulator.exec();
+    simulator.close();
+    return 0;
+}
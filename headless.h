@@ -0,0 +1,153 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "modbusgateway.h"
+#include "modbusslave.h"
+#include "signalengine.h"
+
+// 无界面模式: 按配置文件创建从站, 不创建任何窗口, 也不运行Qt事件循环.
+// 所有TCP从站共用一个reactor, 一个进程可以承载上千个从站端口.
+//
+// 配置示例(plant.json):
+// {
+//     "reactorThreads": 2,
+//     "maxConnections": 10000,
+//     "signalRateHz": 1000,
+//     "slaves": [
+//         { "type": "tcp", "ip": "0.0.0.0", "port": 1502, "count": 1000, "slaveId": 1,
+//           "holdRegister": { "addr": 0, "size": 1000, "values": [1, 2, 3],
+//                             "windows": [ { "addr": 40000, "size": 100 } ] },
+//           "inputRegister": { "addr": 0, "size": 100 } },
+//         { "type": "rtu", "device": "/dev/ttyUSB0", "baud": 9600, "parity": "N",
+//           "dataBits": 8, "stopBits": 1, "slaveId": 2,
+//           "holdRegister": { "addr": 0, "size": 100 } },
+//         { "type": "tcp", "port": 1600, "sharedMemory": "/plant1", "sharedMemoryMode": "0660",
+//           "maxClients": 32, "idleTimeoutMs": 30000, "holdRegister": { "addr": 0, "size": 5000 } },
+//         { "type": "tcp", "port": 1700, "inputRegister": { "addr": 0, "size": 100 },
+//           "signals": [ { "register": "input", "addr": 0, "waveform": "sine", "format": "float32",
+//                          "offset": 50, "amplitude": 10, "periodMs": 2000 },
+//                        { "register": "input", "addr": 2, "waveform": "replay", "csv": "flow.csv", "column": 1 } ] },
+//         { "type": "tcp", "port": 502,
+//           "units": [ { "unitId": 1, "holdRegister": { "addr": 0, "size": 100 } },
+//                      { "unitId": 2, "inputRegister": { "addr": 0, "size": 50 } } ] },
+//         { "type": "rtu", "virtualBus": true, "device": "/tmp/vbus0", "baud": 19200,
+//           "units": [ { "unitId": 1, "holdRegister": { "addr": 0, "size": 100 } },
+//                      { "unitId": 2, "holdRegister": { "addr": 0, "size": 100 } } ] },
+//         { "type": "gateway", "port": 1800, "device": "/tmp/vbus0", "baud": 19200,
+//           "responseTimeoutMs": 500, "queueLimit": 256 }
+//     ]
+// }
+// count表示从port开始连续创建多少个相同的TCP从站; units为网关模式, 每个单元号一组寄存器,
+// RTU从站带units时模拟一条多点总线, 每个单元号是总线上的一台设备;
+// virtualBus在伪终端上模拟RTU总线(仅Linux等POSIX系统), 被测主站打开device(或日志中打印的/dev/pts/N)即可;
+// gateway在port上接受TCP主站, 把请求转发到device上的RTU总线(可以是前面的虚拟总线), 统计定期打印到日志;
+// maxClients/idleTimeoutMs只在没有reactor的平台(每个主站一个线程)上生效, 连接满时新连接在监听队列中等待;
+// windows在addr/size之外再映射若干不连续的地址窗口, 未映射的地址回复非法数据地址异常;
+// sharedMemory让外部进程(如工艺模型)通过共享内存直接更新寄存器, 布局见RegisterBank; 默认只有本用户可以访问,
+// 外部进程以其他用户运行时用sharedMemoryMode(八进制字符串, 如"0660")放宽;
+// signals把寄存器绑定到波形上, 所有从站的信号由同一个节拍线程按signalRateHz刷新.
+// waveform: sine/ramp/square/randomWalk/noise/counter/replay, format: uint16/int16/float32.
+class HeadlessSimulator
+{
+public:
+    struct RegisterConfig
+    {
+        int addr = 0;
+        int size = 0;
+        std::vector<uint16_t> values;
+        // 额外的不连续窗口, 每项为(addr, size)
+        std::vector<std::pair<int, int>> windows;
+    };
+
+    // 绑定到寄存器上的信号, unitId为-1时作用于从站本身的寄存器组
+    struct SignalConfig
+    {
+        ModbusSlave::AddrType type = ModbusSlave::AddrType::INPUT_REGISTER;
+        int unitId = -1;
+        SignalEngine::Signal signal;
+    };
+
+    struct UnitConfig
+    {
+        int unitId = 1;
+        RegisterConfig holdRegister;
+        RegisterConfig inputRegister;
+    };
+
+    struct SlaveConfig
+    {
+        enum class Type : uint8_t
+        {
+            TCP,
+            RTU,
+            GATEWAY
+        };
+        Type type = Type::TCP;
+        int slaveId = 1;
+        // TCP
+        std::string ip = "0.0.0.0";
+        int port = 502;
+        int count = 1;
+        // 每个主站一个线程模式(无reactor的平台)下的连接数上限和空闲断开时间
+        int maxClients = ModbusSlaveTCP::DEFAULT_MAX_CLIENTS;
+        int idleTimeoutMs = ModbusSlaveTCP::DEFAULT_IDLE_TIMEOUT_MS;
+        // RTU; virtualBus为true时不打开串口而是创建伪终端, device为指向其从端的符号链接(可为空)
+        std::string device;
+        bool virtualBus = false;
+        int baud = 9600;
+        char parity = 'N';
+        int dataBits = 8;
+        int stopBits = 1;
+        // 网关
+        int responseTimeoutMs = ModbusGateway::DEFAULT_RESPONSE_TIMEOUT_MS;
+        int queueLimit = ModbusGateway::DEFAULT_QUEUE_LIMIT;
+
+        RegisterConfig holdRegister;
+        RegisterConfig inputRegister;
+        std::vector<UnitConfig> units;
+        // 非空时寄存器放在该名字的共享内存中, count大于1时第i个从站使用sharedMemory + "_" + i
+        std::string sharedMemory;
+        // 新建共享内存的权限, 配置中为八进制字符串(如"0660")
+        int sharedMemoryMode = platform::SHARED_MEMORY_MODE;
+        std::vector<SignalConfig> signals;
+    };
+
+    struct Config
+    {
+        int reactorThreads = 1;
+        // reactor上所有TCP从站合计的连接数上限, 0表示不限
+        int maxConnections = 0;
+        int signalRateHz = SignalEngine::DEFAULT_RATE_HZ;
+        std::vector<SlaveConfig> slaves;
+    };
+
+    // 读取JSON配置, 失败时返回false并在error中说明原因
+    static bool loadConfig(const std::string &path, Config &config, std::string &error);
+
+    ~HeadlessSimulator();
+
+    // 返回成功打开的从站和网关数
+    int open(const Config &config);
+    void close();
+
+    // 运行直到收到SIGINT/SIGTERM
+    void exec();
+
+private:
+    void logGatewayStats() const;
+
+    std::shared_ptr<ModbusTcpReactor> mReactor;
+    std::vector<std::shared_ptr<ModbusSlave>> mSlaves;
+    std::vector<std::unique_ptr<ModbusGateway>> mGateways;
+    std::unique_ptr<SignalEngine> mSignals;
+};
+
+// main中--headless的入口
+int runHeadless(const std::string &configPath);
+
+#endif // HEADLESS_H
@@ -0,0 +1,190 @@
+#include "headless.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace
+{
+HeadlessSimulator::RegisterConfig registerConfig(const QJsonObject &obj)
+{
+    HeadlessSimulator::RegisterConfig conf;
+    conf.addr = obj.value("addr").toInt(0);
+    conf.size = obj.value("size").toInt(0);
+    for (const QJsonValue &val : obj.value("values").toArray())
+    {
+        conf.values.push_back(static_cast<uint16_t>(val.toInt()));
+    }
+    for (const QJsonValue &val : obj.value("windows").toArray())
+    {
+        QJsonObject window = val.toObject();
+        conf.windows.emplace_back(window.value("addr").toInt(0), window.value("size").toInt(0));
+    }
+    return conf;
+}
+
+bool signalConfig(const QJsonObject &obj, HeadlessSimulator::SignalConfig &conf, std::string &error)
+{
+    static const std::pair<const char *, SignalEngine::Waveform> waveforms[] = {
+        {"sine", SignalEngine::Waveform::SINE},
+        {"ramp", SignalEngine::Waveform::RAMP},
+        {"square", SignalEngine::Waveform::SQUARE},
+        {"randomwalk", SignalEngine::Waveform::RANDOM_WALK},
+        {"noise", SignalEngine::Waveform::NOISE},
+        {"counter", SignalEngine::Waveform::COUNTER},
+        {"replay", SignalEngine::Waveform::REPLAY},
+    };
+    static const std::pair<const char *, SignalEngine::Format> formats[] = {
+        {"uint16", SignalEngine::Format::UINT16},
+        {"int16", SignalEngine::Format::INT16},
+        {"float32", SignalEngine::Format::FLOAT32},
+    };
+
+    QString reg = obj.value("register").toString("input").toLower();
+    if (reg != "input" && reg != "hold")
+    {
+        error = "unknown register type " + reg.toStdString();
+        return false;
+    }
+    conf.type = reg == "hold" ? ModbusSlave::AddrType::HOLD_REGISTER : ModbusSlave::AddrType::INPUT_REGISTER;
+    conf.unitId = obj.value("unitId").toInt(-1);
+
+    SignalEngine::Signal &signal = conf.signal;
+    QString waveform = obj.value("waveform").toString("sine").toLower();
+    auto wave = std::find_if(std::begin(waveforms), std::end(waveforms), [&waveform](const auto &item)
+                             { return waveform == item.first; });
+    if (wave == std::end(waveforms))
+    {
+        error = "unknown waveform " + waveform.toStdString();
+        return false;
+    }
+    signal.waveform = wave->second;
+    QString format = obj.value("format").toString("uint16").toLower();
+    auto fmt = std::find_if(std::begin(formats), std::end(formats), [&format](const auto &item)
+                            { return format == item.first; });
+    if (fmt == std::end(formats))
+    {
+        error = "unknown format " + format.toStdString();
+        return false;
+    }
+    signal.format = fmt->second;
+
+    signal.addr = obj.value("addr").toInt(0);
+    signal.offset = obj.value("offset").toDouble(signal.offset);
+    signal.amplitude = obj.value("amplitude").toDouble(signal.amplitude);
+    signal.periodMs = obj.value("periodMs").toDouble(signal.periodMs);
+    signal.phase = obj.value("phase").toDouble(signal.phase);
+    signal.step = obj.value("step").toDouble(signal.step);
+    if (signal.waveform == SignalEngine::Waveform::REPLAY)
+    {
+        std::string csv = obj.value("csv").toString().toStdString();
+        if (!SignalEngine::loadCsv(csv, obj.value("column").toInt(0), signal.samples))
+        {
+            error = "cannot load samples from " + csv;
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+bool HeadlessSimulator::loadConfig(const std::string &path, Config &config, std::string &error)
+{
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        error = "cannot open " + path;
+        return false;
+    }
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!doc.isObject())
+    {
+        error = parseError.errorString().toStdString();
+        return false;
+    }
+
+    QJsonObject root = doc.object();
+    config.reactorThreads = root.value("reactorThreads").toInt(1);
+    config.maxConnections = root.value("maxConnections").toInt(0);
+    config.signalRateHz = root.value("signalRateHz").toInt(SignalEngine::DEFAULT_RATE_HZ);
+    config.slaves.clear();
+    for (const QJsonValue &val : root.value("slaves").toArray())
+    {
+        QJsonObject obj = val.toObject();
+        SlaveConfig slave;
+        QString type = obj.value("type").toString("tcp").toLower();
+        if (type == "rtu")
+        {
+            slave.type = SlaveConfig::Type::RTU;
+        }
+        else if (type == "gateway")
+        {
+            slave.type = SlaveConfig::Type::GATEWAY;
+        }
+        else if (type != "tcp")
+        {
+            error = "unknown slave type " + type.toStdString();
+            return false;
+        }
+        slave.slaveId = obj.value("slaveId").toInt(1);
+        slave.ip = obj.value("ip").toString("0.0.0.0").toStdString();
+        slave.port = obj.value("port").toInt(502);
+        slave.count = std::max(1, obj.value("count").toInt(1));
+        slave.maxClients = obj.value("maxClients").toInt(ModbusSlaveTCP::DEFAULT_MAX_CLIENTS);
+        slave.idleTimeoutMs = obj.value("idleTimeoutMs").toInt(ModbusSlaveTCP::DEFAULT_IDLE_TIMEOUT_MS);
+        slave.device = obj.value("device").toString().toStdString();
+        slave.virtualBus = obj.value("virtualBus").toBool(false);
+        slave.baud = obj.value("baud").toInt(9600);
+        QString parity = obj.value("parity").toString("N");
+        slave.parity = parity.isEmpty() ? 'N' : parity.at(0).toUpper().toLatin1();
+        slave.dataBits = obj.value("dataBits").toInt(8);
+        slave.stopBits = obj.value("stopBits").toInt(1);
+        slave.responseTimeoutMs = obj.value("responseTimeoutMs").toInt(ModbusGateway::DEFAULT_RESPONSE_TIMEOUT_MS);
+        slave.queueLimit = obj.value("queueLimit").toInt(ModbusGateway::DEFAULT_QUEUE_LIMIT);
+        slave.holdRegister = registerConfig(obj.value("holdRegister").toObject());
+        slave.inputRegister = registerConfig(obj.value("inputRegister").toObject());
+        for (const QJsonValue &unitVal : obj.value("units").toArray())
+        {
+            QJsonObject unitObj = unitVal.toObject();
+            UnitConfig unit;
+            unit.unitId = unitObj.value("unitId").toInt(1);
+            unit.holdRegister = registerConfig(unitObj.value("holdRegister").toObject());
+            unit.inputRegister = registerConfig(unitObj.value("inputRegister").toObject());
+            slave.units.push_back(unit);
+        }
+        slave.sharedMemory = obj.value("sharedMemory").toString().toStdString();
+        QString sharedMemoryMode = obj.value("sharedMemoryMode").toString();
+        if (!sharedMemoryMode.isEmpty())
+        {
+            bool ok = false;
+            slave.sharedMemoryMode = sharedMemoryMode.toInt(&ok, 8);
+            if (!ok || slave.sharedMemoryMode < 0 || slave.sharedMemoryMode > 0777)
+            {
+                error = "invalid sharedMemoryMode " + sharedMemoryMode.toStdString();
+                return false;
+            }
+        }
+        for (const QJsonValue &signalVal : obj.value("signals").toArray())
+        {
+            SignalConfig signal;
+            if (!signalConfig(signalVal.toObject(), signal, error))
+            {
+                return false;
+            }
+            slave.signals.push_back(signal);
+        }
+        config.slaves.push_back(slave);
+    }
+    if (config.slaves.empty())
+    {
+        error = "no slave configured";
+        return false;
+    }
+    return true;
+}
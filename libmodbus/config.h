@@ -109,7 +109,9 @@
 /* #undef HAVE_VFORK_H */
 
 /* Define to 1 if you have the <winsock2.h> header file. */
+#if defined(_WIN32)
 #define HAVE_WINSOCK2_H 1
+#endif
 
 /* Define to 1 if `fork' works. */
 /* #undef HAVE_WORKING_FORK */
@@ -162,3 +164,26 @@
 
 /* Define as `fork' if `vfork' does not work. */
 #define vfork fork
+
+/* Native POSIX builds: the values configure detects on Linux/glibc. */
+#if !defined(_WIN32)
+#define HAVE_ARPA_INET_H 1
+#define HAVE_NETDB_H 1
+#define HAVE_NETINET_IN_H 1
+#define HAVE_NETINET_TCP_H 1
+#define HAVE_SYS_IOCTL_H 1
+#define HAVE_SYS_SOCKET_H 1
+#define HAVE_TERMIOS_H 1
+#define HAVE_UNISTD_H 1
+#define HAVE_GETADDRINFO 1
+#define HAVE_SELECT 1
+#define HAVE_SOCKET 1
+#endif
+
+#if defined(__linux__)
+#define HAVE_ACCEPT4 1
+#define HAVE_BYTESWAP_H 1
+#define HAVE_LINUX_SERIAL_H 1
+#define HAVE_DECL_TIOCSRS485 1
+#define HAVE_DECL_TIOCM_RTS 1
+#endif
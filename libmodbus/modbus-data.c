@@ -25,6 +25,7 @@
 #include "config.h"
 
 #include "modbus.h"
+#include "modbus-private.h"
 
 #if defined(HAVE_BYTESWAP_H)
 #  include <byteswap.h>
@@ -70,8 +71,139 @@ static inline uint32_t bswap_32(uint32_t x)
     return (bswap_16(x & 0xffff) << 16) | (bswap_16(x >> 16));
 }
 #endif
+
+/* x86 is little-endian so converting registers is a plain byte swap of each
+   16-bit word, done with pshufb. The kernels are compiled for their own
+   instruction set and selected at run time, the library itself keeps the
+   baseline target. */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#  define MODBUS_SWAP_SIMD
+#  define TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+#  include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define MODBUS_SWAP_SIMD
+#  define TARGET_SSSE3
+#  define TARGET_AVX2
+#  include <intrin.h>
+#  include <immintrin.h>
+#endif
 // clang-format on
 
+#if defined(MODBUS_SWAP_SIMD)
+typedef void (*swap16_fn_t)(uint8_t *dest, const uint8_t *src, int nb);
+
+static void swap16_scalar(uint8_t *dest, const uint8_t *src, int nb)
+{
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        uint8_t hi = src[2 * i];
+
+        dest[2 * i] = src[2 * i + 1];
+        dest[2 * i + 1] = hi;
+    }
+}
+
+TARGET_SSSE3 static void swap16_ssse3(uint8_t *dest, const uint8_t *src, int nb)
+{
+    const __m128i mask =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    int i = 0;
+
+    for (; i + 8 <= nb; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+        _mm_storeu_si128((__m128i *) (dest + 2 * i), _mm_shuffle_epi8(v, mask));
+    }
+    swap16_scalar(dest + 2 * i, src + 2 * i, nb - i);
+}
+
+TARGET_AVX2 static void swap16_avx2(uint8_t *dest, const uint8_t *src, int nb)
+{
+    /* pshufb works per 128-bit lane, the word pairs never cross them */
+    const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                          1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    int i = 0;
+
+    for (; i + 16 <= nb; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + 2 * i));
+        _mm256_storeu_si256((__m256i *) (dest + 2 * i), _mm256_shuffle_epi8(v, mask));
+    }
+    /* The tail stays in this function: calling the legacy SSE kernel with the
+       upper YMM halves dirty would cost a state transition */
+    for (; i + 8 <= nb; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src + 2 * i));
+        _mm_storeu_si128((__m128i *) (dest + 2 * i),
+                         _mm_shuffle_epi8(v, _mm256_castsi256_si128(mask)));
+    }
+    swap16_scalar(dest + 2 * i, src + 2 * i, nb - i);
+}
+
+static swap16_fn_t swap16_select(void)
+{
+#  if defined(_MSC_VER)
+    int info[4];
+    int has_ssse3;
+    int has_avx2 = 0;
+
+    __cpuid(info, 1);
+    has_ssse3 = (info[2] >> 9) & 1;
+    /* AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0) */
+    if (((info[2] >> 27) & 1) && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        has_avx2 = (info[1] >> 5) & 1;
+    }
+#  else
+    int has_ssse3;
+    int has_avx2;
+
+    __builtin_cpu_init();
+    has_ssse3 = __builtin_cpu_supports("ssse3");
+    has_avx2 = __builtin_cpu_supports("avx2");
+#  endif
+
+    if (has_avx2)
+        return swap16_avx2;
+    if (has_ssse3)
+        return swap16_ssse3;
+    return swap16_scalar;
+}
+
+static void swap16(uint8_t *dest, const uint8_t *src, int nb)
+{
+    _MODBUS_RESOLVE_ONCE(swap16_fn_t, f, swap16_select);
+
+    f(dest, src, nb);
+}
+#endif
+
+void modbus_encode_registers(uint8_t *dest, const uint16_t *src, int nb)
+{
+#if defined(MODBUS_SWAP_SIMD)
+    swap16(dest, (const uint8_t *) src, nb);
+#else
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[2 * i] = src[i] >> 8;
+        dest[2 * i + 1] = src[i] & 0xFF;
+    }
+#endif
+}
+
+void modbus_decode_registers(uint16_t *dest, const uint8_t *src, int nb)
+{
+#if defined(MODBUS_SWAP_SIMD)
+    swap16((uint8_t *) dest, src, nb);
+#else
+    int i;
+
+    for (i = 0; i < nb; i++) {
+        dest[i] = (src[2 * i] << 8) | src[2 * i + 1];
+    }
+#endif
+}
+
 /* Sets many bits from a single byte value (all 8 bits of the byte value are
    set) */
 void modbus_set_bits_from_byte(uint8_t *dest, int idx, const uint8_t value)
@@ -91,8 +91,22 @@ typedef struct _modbus_backend {
     int (*flush)(modbus_t *ctx);
     int (*select)(modbus_t *ctx, fd_set *rset, struct timeval *tv, int msg_length);
     void (*free)(modbus_t *ctx);
+    /* Optional, replaces the length driven framing of _modbus_receive_msg */
+    int (*receive_msg)(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type);
 } modbus_backend_t;
 
+/* Function codes 0x80 and above are exception responses */
+#define _MODBUS_MAX_FUNCTION_CODE 0x7F
+
+typedef struct {
+    modbus_reply_handler_t handler;
+    void *user_data;
+} modbus_reply_entry_t;
+
+struct _modbus_reply_table {
+    modbus_reply_entry_t entries[_MODBUS_MAX_FUNCTION_CODE + 1];
+};
+
 struct _modbus {
     /* Slave address */
     int slave;
@@ -104,6 +118,11 @@ struct _modbus {
     struct timeval response_timeout;
     struct timeval byte_timeout;
     struct timeval indication_timeout;
+    /* Set by the exception path of modbus_reply when the rest of the indication
+       must be dropped, handled by the next receive of the backend */
+    int flush_pending;
+    /* Server-side handlers overriding the default ones, not owned */
+    const modbus_reply_table_t *reply_table;
     const modbus_backend_t *backend;
     void *backend_data;
 };
@@ -111,6 +130,35 @@ struct _modbus {
 void _modbus_init_common(modbus_t *ctx);
 void _error_print(modbus_t *ctx, const char *context);
 int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type);
+int _modbus_expected_length(modbus_t *ctx,
+                            uint8_t *msg,
+                            int msg_length,
+                            msg_type_t msg_type);
+
+/* Declares fn, of type fn_t, set to the kernel picked by select() on first
+   use. Concurrent first calls store the same pointer; the accesses are atomic
+   so that race stays defined, relaxed is enough as the pointer publishes no
+   other data. With MSVC, aligned pointer accesses are atomic on x86 and
+   volatile keeps them single. */
+// clang-format off
+#if defined(_MSC_VER)
+# define _MODBUS_RESOLVE_ONCE(fn_t, fn, select)                             \
+    static fn_t volatile _resolved_##fn = NULL;                             \
+    fn_t fn = _resolved_##fn;                                               \
+    if (fn == NULL) {                                                       \
+        fn = select();                                                      \
+        _resolved_##fn = fn;                                                \
+    }
+#else
+# define _MODBUS_RESOLVE_ONCE(fn_t, fn, select)                             \
+    static fn_t _resolved_##fn = NULL;                                      \
+    fn_t fn = __atomic_load_n(&_resolved_##fn, __ATOMIC_RELAXED);           \
+    if (fn == NULL) {                                                       \
+        fn = select();                                                      \
+        __atomic_store_n(&_resolved_##fn, fn, __ATOMIC_RELAXED);            \
+    }
+#endif
+// clang-format on
 
 #ifndef HAVE_STRLCPY
 size_t strlcpy(char *dest, const char *src, size_t dest_size);
@@ -25,6 +25,10 @@
 
 #define _MODBUS_RTU_CHECKSUM_LENGTH 2
 
+/* Address, function code and CRC, the shortest frame */
+#define _MODBUS_RTU_MIN_ADU_LENGTH \
+    (_MODBUS_RTU_HEADER_LENGTH + 1 + _MODBUS_RTU_CHECKSUM_LENGTH)
+
 #if defined(_WIN32)
 #if !defined(ENOTSUP)
 #define ENOTSUP WSAEOPNOTSUPP
@@ -72,6 +76,24 @@ typedef struct _modbus_rtu {
 #endif
     /* To handle many slaves on the same link */
     int confirmation_to_ignore;
+    /* Server side: unit identifiers answered in place of ctx->slave, one bit
+       per address */
+    int use_slave_mask;
+    uint8_t slave_mask[32];
+    /* Silent intervals of the framing in microseconds: t3.5 of silence ends
+       a frame, a gap longer than t1.5 inside it corrupts it when check_t15 is
+       set */
+    int t15;
+    int t35;
+    int check_t15;
+    /* Monotonic time in microseconds of the last received chunk, 0 if none.
+       The next transmission waits until t3.5 after it. */
+    int64_t last_rx;
+    /* Running CRC of the frame being received, folded in as each chunk is
+       read. It covers the bytes from crc_start to crc_end. */
+    const uint8_t *crc_start;
+    const uint8_t *crc_end;
+    uint16_t crc;
 } modbus_rtu_t;
 
 #endif /* MODBUS_RTU_PRIVATE_H */
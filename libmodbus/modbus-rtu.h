@@ -35,9 +35,28 @@ MODBUS_API int modbus_rtu_get_rts(modbus_t *ctx);
 MODBUS_API int modbus_rtu_set_custom_rts(modbus_t *ctx,
                                          void (*set_rts)(modbus_t *ctx, int on));
 
+/* Server side: answers every unit identifier set in mask (32 bytes, bit n & 7
+   of byte n / 8 for address n) instead of the slave address only, eg. to host
+   a whole multi-drop bus behind one port. The context is then assumed to be
+   the only responder on the line: a request for another address isn't
+   followed by a response to skip. NULL restores the filter on the slave
+   address. */
+MODBUS_API int modbus_rtu_set_slave_mask(modbus_t *ctx, const uint8_t *mask);
+
 MODBUS_API int modbus_rtu_set_rts_delay(modbus_t *ctx, int us);
 MODBUS_API int modbus_rtu_get_rts_delay(modbus_t *ctx);
 
+/* Silent intervals delimiting the frames, in microseconds. By default 1.5 and
+   3.5 character times at the configured baud rate (750 and 1750 above 19200
+   bauds). Adapters that deliver bytes in bursts (eg. USB with a latency timer)
+   need a longer t3.5. */
+MODBUS_API int modbus_rtu_set_silent_intervals(modbus_t *ctx, int t15_us, int t35_us);
+MODBUS_API int modbus_rtu_get_silent_intervals(modbus_t *ctx, int *t15_us, int *t35_us);
+/* Discards a frame with a gap longer than t1.5 between two characters. Off by
+   default: the gap is measured between the reads of the bytes, not their
+   arrival, and a loaded host would drop valid frames. */
+MODBUS_API int modbus_rtu_set_t15_check(modbus_t *ctx, int enable);
+
 MODBUS_END_DECLS
 
 #endif /* MODBUS_RTU_H */
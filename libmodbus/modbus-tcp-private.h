@@ -13,14 +13,45 @@
 
 #define _MODBUS_TCP_CHECKSUM_LENGTH 0
 
+/* Room for several indications (4 * MODBUS_TCP_MAX_ADU_LENGTH) so pipelined
+   requests are fetched by a single recv() */
+#define _MODBUS_TCP_RX_BUFFER_LENGTH 1040
+
+/* Receive buffer of the server side, the indications are sliced out of it
+   with the MBAP length */
+typedef struct _modbus_tcp_rx {
+    uint8_t buf[_MODBUS_TCP_RX_BUFFER_LENGTH];
+    int start;
+    int end;
+} modbus_tcp_rx_t;
+
+/* Enough for the responses to a full receive buffer of short requests */
+#define _MODBUS_TCP_TX_BUFFER_LENGTH MODBUS_TCP_SEND_BUFFER_LENGTH
+
+/* Messages sent while the connection is corked are gathered here and sent
+   together when it's uncorked (see modbus_tcp_set_cork) */
+typedef struct _modbus_tcp_tx {
+    uint8_t buf[_MODBUS_TCP_TX_BUFFER_LENGTH];
+    int length;
+    int cork;
+    /* The unsent tail is kept instead of waiting for the socket (see
+       modbus_tcp_set_send_nonblocking) */
+    int nonblocking;
+} modbus_tcp_tx_t;
+
 /* In both structures, the transaction ID must be placed on first position
-   to have a quick access not dependent of the TCP backend */
+   and the receive and send buffers on second and third positions to have a
+   quick access not dependent of the TCP backend */
 typedef struct _modbus_tcp {
     /* Extract from MODBUS Messaging on TCP/IP Implementation Guide V1.0b
        (page 23/46):
        The transaction identifier is used to associate the future response
        with the request. This identifier is unique on each TCP connection. */
     uint16_t t_id;
+    /* Buffered indications */
+    modbus_tcp_rx_t rx;
+    /* Corked messages */
+    modbus_tcp_tx_t tx;
     /* TCP port */
     int port;
     /* IP address */
@@ -30,6 +61,10 @@ typedef struct _modbus_tcp {
 typedef struct _modbus_tcp_pi {
     /* Transaction ID */
     uint16_t t_id;
+    /* Buffered indications */
+    modbus_tcp_rx_t rx;
+    /* Corked messages */
+    modbus_tcp_tx_t tx;
     /* TCP port */
     int port;
     /* Node */
@@ -45,6 +45,7 @@
 # include <netinet/tcp.h>
 # include <arpa/inet.h>
 # include <netdb.h>
+# include <poll.h>
 #endif
 
 #if !defined(MSG_NOSIGNAL)
@@ -78,6 +79,49 @@ static int _modbus_tcp_init_win32(void)
 }
 #endif
 
+static int _modbus_tcp_would_block(void)
+{
+#ifdef OS_WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/* Waits until the socket is readable (or writable), up to the timeout when
+   one is given. poll() is used where available because select() can't watch
+   descriptors above FD_SETSIZE, which a server with thousands of listening
+   sockets and connections reaches quickly. */
+static int _modbus_tcp_poll(modbus_t *ctx, int for_write, struct timeval *tv)
+{
+    int rc;
+#ifdef OS_WIN32
+    fd_set set;
+
+    FD_ZERO(&set);
+    FD_SET(ctx->s, &set);
+    rc = select(ctx->s + 1, for_write ? NULL : &set, for_write ? &set : NULL, NULL, tv);
+#else
+    struct pollfd pfd;
+    int timeout = -1;
+
+    if (tv != NULL) {
+        timeout = tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+    }
+    pfd.fd = ctx->s;
+    pfd.events = for_write ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    do {
+        rc = poll(&pfd, 1, timeout);
+    } while (rc == -1 && errno == EINTR);
+#endif
+    if (rc == 0) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    return rc;
+}
+
 static int _modbus_set_slave(modbus_t *ctx, int slave)
 {
     int max_slave = (ctx->quirks & MODBUS_QUIRK_MAX_SLAVE) ? 255 : 247;
@@ -167,18 +211,322 @@ static int _modbus_tcp_send_msg_pre(uint8_t *req, int req_length)
     return req_length;
 }
 
+/* Sends the whole buffer, waiting for the socket when it's non-blocking */
+static int _modbus_tcp_send_all(modbus_t *ctx, const uint8_t *buf, int length)
+{
+    int sent = 0;
+
+    while (sent < length) {
+        /* MSG_NOSIGNAL
+           Requests not to send SIGPIPE on errors on stream oriented
+           sockets when the other end breaks the connection.  The EPIPE
+           error is still returned. */
+        ssize_t rc = send(ctx->s, (const char *) buf + sent, length - sent, MSG_NOSIGNAL);
+        if (rc == -1) {
+            struct timeval tv = ctx->response_timeout;
+
+            if (!_modbus_tcp_would_block() || _modbus_tcp_poll(ctx, TRUE, &tv) == -1) {
+                return -1;
+            }
+            continue;
+        }
+        sent += rc;
+    }
+
+    return sent;
+}
+
+/* Sends as much of the gathered messages as the socket takes without waiting,
+   the unsent tail is moved to the start of the buffer. Returns the number of
+   bytes left. */
+static int _modbus_tcp_send_available(modbus_t *ctx)
+{
+    modbus_tcp_tx_t *tx = &((modbus_tcp_t *) ctx->backend_data)->tx;
+    int sent = 0;
+
+    while (sent < tx->length) {
+        ssize_t rc = send(ctx->s, (const char *) tx->buf + sent, tx->length - sent, MSG_NOSIGNAL);
+        if (rc == -1) {
+            if (_modbus_tcp_would_block()) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            tx->length = 0;
+            return -1;
+        }
+        sent += rc;
+    }
+    if (sent > 0) {
+        memmove(tx->buf, tx->buf + sent, tx->length - sent);
+        tx->length -= sent;
+    }
+
+    return tx->length;
+}
+
 static ssize_t _modbus_tcp_send(modbus_t *ctx, const uint8_t *req, int req_length)
 {
-    /* MSG_NOSIGNAL
-       Requests not to send SIGPIPE on errors on stream oriented
-       sockets when the other end breaks the connection.  The EPIPE
-       error is still returned. */
-    return send(ctx->s, (const char *) req, req_length, MSG_NOSIGNAL);
+    modbus_tcp_tx_t *tx = &((modbus_tcp_t *) ctx->backend_data)->tx;
+
+    if (!tx->cork && !tx->nonblocking) {
+        /* MSG_NOSIGNAL
+           Requests not to send SIGPIPE on errors on stream oriented
+           sockets when the other end breaks the connection.  The EPIPE
+           error is still returned. */
+        return send(ctx->s, (const char *) req, req_length, MSG_NOSIGNAL);
+    }
+
+    if (tx->length + req_length > _MODBUS_TCP_TX_BUFFER_LENGTH) {
+        if (tx->nonblocking) {
+            if (_modbus_tcp_send_available(ctx) == -1) {
+                return -1;
+            }
+            if (tx->length + req_length > _MODBUS_TCP_TX_BUFFER_LENGTH) {
+                /* The caller checks modbus_tcp_get_send_pending() first */
+                errno = EAGAIN;
+                return -1;
+            }
+        } else {
+            if (_modbus_tcp_send_all(ctx, tx->buf, tx->length) == -1) {
+                tx->length = 0;
+                return -1;
+            }
+            tx->length = 0;
+        }
+    }
+    memcpy(tx->buf + tx->length, req, req_length);
+    tx->length += req_length;
+
+    /* Behind an unsent tail, a message must wait for its turn */
+    if (!tx->cork && _modbus_tcp_send_available(ctx) == -1) {
+        return -1;
+    }
+
+    return req_length;
+}
+
+/* Returns TRUE when a complete indication is already buffered, so it can be
+   received without waiting */
+int modbus_tcp_has_indication(modbus_t *ctx)
+{
+    modbus_tcp_rx_t *rx;
+    const uint8_t *msg;
+
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rx = &((modbus_tcp_t *) ctx->backend_data)->rx;
+    if (rx->end - rx->start < _MODBUS_TCP_HEADER_LENGTH) {
+        return FALSE;
+    }
+    msg = rx->buf + rx->start;
+    /* An invalid header is reported by the next receive */
+    return (rx->end - rx->start) >= 6 + ((msg[4] << 8) | msg[5]);
 }
 
+/* While the connection is corked, the messages are gathered instead of being
+   sent one by one. Uncorking sends them with a single call, so a server can
+   answer all the pipelined requests of a connection at once. */
+int modbus_tcp_set_cork(modbus_t *ctx, int cork)
+{
+    modbus_tcp_tx_t *tx;
+    int rc = 0;
+
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    tx = &((modbus_tcp_t *) ctx->backend_data)->tx;
+    tx->cork = cork;
+    if (!cork && tx->length > 0 && tx->nonblocking) {
+        if (_modbus_tcp_send_available(ctx) == -1) {
+            _error_print(ctx, "send");
+            return -1;
+        }
+    } else if (!cork && tx->length > 0) {
+        rc = _modbus_tcp_send_all(ctx, tx->buf, tx->length);
+        tx->length = 0;
+        if (rc == -1) {
+            _error_print(ctx, "send");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* In the non-blocking mode, for a server multiplexing its connections on
+   non-blocking sockets, the messages the socket doesn't take at once stay in
+   the send buffer instead of waiting for the peer to read. The caller sends
+   them later with modbus_tcp_flush_send() when the socket is writable, and
+   must not produce more than the room left (see
+   modbus_tcp_get_send_pending()) in the meantime. */
+int modbus_tcp_set_send_nonblocking(modbus_t *ctx, int nonblocking)
+{
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ((modbus_tcp_t *) ctx->backend_data)->tx.nonblocking = nonblocking;
+    return 0;
+}
+
+/* Sends what the socket takes without waiting, returns the number of bytes
+   still pending */
+int modbus_tcp_flush_send(modbus_t *ctx)
+{
+    int rc;
+
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rc = _modbus_tcp_send_available(ctx);
+    if (rc == -1) {
+        _error_print(ctx, "send");
+    }
+    return rc;
+}
+
+int modbus_tcp_get_send_pending(modbus_t *ctx)
+{
+    if (ctx == NULL || ctx->backend->backend_type != _MODBUS_BACKEND_TYPE_TCP) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ((modbus_tcp_t *) ctx->backend_data)->tx.length;
+}
+
+/* Receives an indication from the buffer of the connection. Each recv() takes
+   everything available (up to the buffer size) and the requests are sliced
+   out with the MBAP length, so a pipelined request already buffered costs no
+   system call and an illegal request can't desynchronize the stream. */
 static int _modbus_tcp_receive(modbus_t *ctx, uint8_t *req)
 {
-    return _modbus_receive_msg(ctx, req, MSG_INDICATION);
+    modbus_tcp_rx_t *rx = &((modbus_tcp_t *) ctx->backend_data)->rx;
+    struct timeval tv;
+    struct timeval *p_tv;
+
+    /* Nothing to flush, the MBAP length delimits the indications */
+    ctx->flush_pending = FALSE;
+
+    if (ctx->debug) {
+        printf("Waiting for an indication...\n");
+    }
+
+    if (!ctx->backend->is_connected(ctx)) {
+        if (ctx->debug) {
+            fprintf(stderr, "ERROR The connection is not established.\n");
+        }
+        return -1;
+    }
+
+    for (;;) {
+        int available = rx->end - rx->start;
+        int rc;
+
+        if (available >= _MODBUS_TCP_HEADER_LENGTH) {
+            const uint8_t *msg = rx->buf + rx->start;
+            int protocol_id = (msg[2] << 8) | msg[3];
+            int msg_length = 6 + ((msg[4] << 8) | msg[5]);
+
+            if (protocol_id != 0 || msg_length <= _MODBUS_TCP_HEADER_LENGTH ||
+                msg_length > MODBUS_TCP_MAX_ADU_LENGTH) {
+                /* The stream can't be resynchronized */
+                rx->start = rx->end = 0;
+                errno = EMBBADDATA;
+                _error_print(ctx, "invalid MBAP header");
+                return -1;
+            }
+
+            if (available >= msg_length) {
+                int expected =
+                    _modbus_expected_length(ctx, (uint8_t *) msg, msg_length, MSG_INDICATION);
+
+                memcpy(req, msg, msg_length);
+                rx->start += msg_length;
+                if (rx->start == rx->end) {
+                    rx->start = rx->end = 0;
+                }
+
+                /* The MBAP length is shorter than the function code implies,
+                   the rest of the request would be read from stale bytes */
+                if (expected == 0 || msg_length < expected) {
+                    errno = EMBBADDATA;
+                    _error_print(ctx, "truncated indication");
+                    return -1;
+                }
+
+                if (ctx->debug) {
+                    int i;
+                    for (i = 0; i < msg_length; i++)
+                        printf("<%.2X>", req[i]);
+                    printf("\n");
+                }
+                return msg_length;
+            }
+        }
+
+        /* Moves the incomplete indication to the beginning of the buffer */
+        if (rx->start > 0) {
+            memmove(rx->buf, rx->buf + rx->start, available);
+            rx->start = 0;
+            rx->end = available;
+        }
+
+        if (available == 0) {
+            /* Wait for a new indication */
+            if (ctx->indication_timeout.tv_sec == 0 &&
+                ctx->indication_timeout.tv_usec == 0) {
+                p_tv = NULL;
+            } else {
+                tv = ctx->indication_timeout;
+                p_tv = &tv;
+            }
+        } else if (ctx->byte_timeout.tv_sec > 0 || ctx->byte_timeout.tv_usec > 0) {
+            /* End of an incomplete indication */
+            tv = ctx->byte_timeout;
+            p_tv = &tv;
+        } else {
+            p_tv = NULL;
+        }
+
+        /* Without timeout, a blocking recv() is enough and saves the select() */
+        if (p_tv != NULL && _modbus_tcp_poll(ctx, FALSE, p_tv) == -1) {
+            _error_print(ctx, "select");
+            return -1;
+        }
+
+        rc = recv(ctx->s,
+                  (char *) rx->buf + rx->end,
+                  _MODBUS_TCP_RX_BUFFER_LENGTH - rx->end,
+                  0);
+        if (rc == -1 && p_tv == NULL && _modbus_tcp_would_block()) {
+            /* Non-blocking socket (inherited from the listening one) */
+            if (_modbus_tcp_poll(ctx, FALSE, NULL) == -1) {
+                _error_print(ctx, "select");
+                return -1;
+            }
+            continue;
+        }
+        if (rc == 0) {
+            errno = ECONNRESET;
+            rc = -1;
+        }
+        if (rc == -1) {
+            _error_print(ctx, "read");
+            return -1;
+        }
+        rx->end += rc;
+    }
 }
 
 static ssize_t _modbus_tcp_recv(modbus_t *ctx, uint8_t *rsp, int rsp_length)
@@ -457,6 +805,10 @@ static unsigned int _modbus_tcp_is_connected(modbus_t *ctx)
 /* Closes the network connection and socket in TCP mode */
 static void _modbus_tcp_close(modbus_t *ctx)
 {
+    modbus_tcp_t *ctx_tcp = ctx->backend_data;
+
+    ctx_tcp->rx.start = ctx_tcp->rx.end = 0;
+    ctx_tcp->tx.length = 0;
     if (ctx->s >= 0) {
         shutdown(ctx->s, SHUT_RDWR);
         close(ctx->s);
@@ -466,8 +818,11 @@ static void _modbus_tcp_close(modbus_t *ctx)
 
 static int _modbus_tcp_flush(modbus_t *ctx)
 {
+    modbus_tcp_rx_t *rx = &((modbus_tcp_t *) ctx->backend_data)->rx;
     int rc;
-    int rc_sum = 0;
+    int rc_sum = rx->end - rx->start;
+
+    rx->start = rx->end = 0;
 
     do {
         /* Extract the garbage from the socket */
@@ -824,7 +1179,8 @@ const modbus_backend_t _modbus_tcp_backend = {
     _modbus_tcp_close,
     _modbus_tcp_flush,
     _modbus_tcp_select,
-    _modbus_tcp_free
+    _modbus_tcp_free,
+    NULL
 };
 
 const modbus_backend_t _modbus_tcp_pi_backend = {
@@ -847,7 +1203,8 @@ const modbus_backend_t _modbus_tcp_pi_backend = {
     _modbus_tcp_close,
     _modbus_tcp_flush,
     _modbus_tcp_select,
-    _modbus_tcp_pi_free
+    _modbus_tcp_pi_free,
+    NULL
 };
 
 // clang-format on
@@ -912,6 +1269,10 @@ modbus_t *modbus_new_tcp(const char *ip, int port)
     }
     ctx_tcp->port = port;
     ctx_tcp->t_id = 0;
+    ctx_tcp->rx.start = ctx_tcp->rx.end = 0;
+    ctx_tcp->tx.length = 0;
+    ctx_tcp->tx.cork = FALSE;
+    ctx_tcp->tx.nonblocking = FALSE;
 
     return ctx;
 }
@@ -969,6 +1330,10 @@ modbus_t *modbus_new_tcp_pi(const char *node, const char *service)
     }
 
     ctx_tcp_pi->t_id = 0;
+    ctx_tcp_pi->rx.start = ctx_tcp_pi->rx.end = 0;
+    ctx_tcp_pi->tx.length = 0;
+    ctx_tcp_pi->tx.cork = FALSE;
+    ctx_tcp_pi->tx.nonblocking = FALSE;
 
     return ctx;
 }
@@ -39,10 +39,19 @@ MODBUS_BEGIN_DECLS
  */
 #define MODBUS_TCP_MAX_ADU_LENGTH 260
 
+/* Size of the buffer gathering the messages of a corked connection */
+#define MODBUS_TCP_SEND_BUFFER_LENGTH 2080
+
 MODBUS_API modbus_t *modbus_new_tcp(const char *ip_address, int port);
 MODBUS_API int modbus_tcp_listen(modbus_t *ctx, int nb_connection);
 MODBUS_API int modbus_tcp_accept(modbus_t *ctx, int *s);
 
+MODBUS_API int modbus_tcp_has_indication(modbus_t *ctx);
+MODBUS_API int modbus_tcp_set_cork(modbus_t *ctx, int cork);
+MODBUS_API int modbus_tcp_set_send_nonblocking(modbus_t *ctx, int nonblocking);
+MODBUS_API int modbus_tcp_flush_send(modbus_t *ctx);
+MODBUS_API int modbus_tcp_get_send_pending(modbus_t *ctx);
+
 MODBUS_API modbus_t *modbus_new_tcp_pi(const char *node, const char *service);
 MODBUS_API int modbus_tcp_pi_listen(modbus_t *ctx, int nb_connection);
 MODBUS_API int modbus_tcp_pi_accept(modbus_t *ctx, int *s);
@@ -255,6 +255,41 @@ int modbus_send_raw_request(modbus_t *ctx, const uint8_t *raw_req, int raw_req_l
     return send_msg(ctx, req, req_length);
 }
 
+/* Same as modbus_send_raw_request but the request gets the next transaction
+   ID of the context so several requests can be sent before reading the
+   confirmations, which are matched with the returned ID (always 0 in RTU).
+   The function shall return -1 if an error occurred. */
+int modbus_send_raw_request_tid(modbus_t *ctx, const uint8_t *raw_req, int raw_req_length)
+{
+    uint8_t req[MAX_MESSAGE_LENGTH];
+    int req_length;
+    int dummy_length = 0;
+
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (raw_req_length < 2 || raw_req_length > (MODBUS_MAX_PDU_LENGTH + 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Only the header is kept (transaction ID), the slave and the PDU are
+       copied from the raw request */
+    ctx->backend->build_request_basis(ctx, raw_req[1], 0, 0, req);
+    req_length = ctx->backend->header_length;
+    req[req_length - 1] = raw_req[0];
+    memcpy(req + req_length, raw_req + 1, raw_req_length - 1);
+    req_length += raw_req_length - 1;
+
+    if (send_msg(ctx, req, req_length) == -1) {
+        return -1;
+    }
+
+    return ctx->backend->prepare_response_tid(req, &dummy_length);
+}
+
 /*
  *  ---------- Request     Indication ----------
  *  | Client | ---------------------->| Server |
@@ -335,6 +370,26 @@ compute_data_length_after_meta(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
     return length;
 }
 
+/* Returns the length of the message starting at msg as soon as enough of it
+   has been received to derive it from the function code, 0 until then */
+int _modbus_expected_length(modbus_t *ctx,
+                            uint8_t *msg,
+                            int msg_length,
+                            msg_type_t msg_type)
+{
+    const int offset = ctx->backend->header_length;
+    int meta_length;
+
+    if (msg_length < offset + 1) {
+        return 0;
+    }
+    meta_length = compute_meta_length_after_function(msg[offset], msg_type);
+    if (msg_length < offset + 1 + meta_length) {
+        return 0;
+    }
+    return offset + 1 + meta_length + compute_data_length_after_meta(ctx, msg, msg_type);
+}
+
 /* Waits a response from a modbus server or a request from a modbus client.
    This function blocks if there is no replies (3 timeouts).
 
@@ -375,6 +430,10 @@ int _modbus_receive_msg(modbus_t *ctx, uint8_t *msg, msg_type_t msg_type)
         return -1;
     }
 
+    if (ctx->backend->receive_msg) {
+        return ctx->backend->receive_msg(ctx, msg, msg_type);
+    }
+
     /* Add a file descriptor to the set */
     FD_ZERO(&rset);
     FD_SET(ctx->s, &rset);
@@ -754,10 +813,12 @@ static int response_exception(modbus_t *ctx,
         va_end(ap);
     }
 
-    /* Flush if required */
+    /* Flush if required. The server doesn't wait for the response timeout
+       here because it would stall the reply: the TCP backend skips the rest
+       of the indication thanks to the MBAP length and the RTU backend has
+       already consumed the whole frame up to its silent interval. */
     if (to_flush) {
-        _sleep_response_timeout(ctx);
-        modbus_flush(ctx);
+        ctx->flush_pending = TRUE;
     }
 
     /* Build exception response */
@@ -768,6 +829,510 @@ static int response_exception(modbus_t *ctx,
     return rsp_length;
 }
 
+/* The default handlers of the server, one per function code. Each one builds
+   the response (or the exception response) of the indication in rsp and
+   returns its length, or -1 when no response must be sent. */
+typedef int (*reply_fn_t)(modbus_t *ctx,
+                          const uint8_t *req,
+                          int req_length,
+                          uint8_t *rsp,
+                          sft_t *sft,
+                          modbus_mapping_t *mb_mapping);
+
+static int reply_read_bits(modbus_t *ctx,
+                           const uint8_t *req,
+                           int req_length,
+                           uint8_t *rsp,
+                           sft_t *sft,
+                           modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const int function = sft->function;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    unsigned int is_input = (function == MODBUS_FC_READ_DISCRETE_INPUTS);
+    int start_bits = is_input ? mb_mapping->start_input_bits : mb_mapping->start_bits;
+    int nb_bits = is_input ? mb_mapping->nb_input_bits : mb_mapping->nb_bits;
+    uint8_t *tab_bits = is_input ? mb_mapping->tab_input_bits : mb_mapping->tab_bits;
+    const char *const name = is_input ? "read_input_bits" : "read_bits";
+    int nb = (req[offset + 3] << 8) + req[offset + 4];
+    /* The mapping can be shifted to reduce memory consumption and it
+       doesn't always start at address zero. */
+    int mapping_address = address - start_bits;
+
+    (void) req_length;
+
+    if (nb < 1 || MODBUS_MAX_READ_BITS < nb) {
+        rsp_length = response_exception(ctx,
+                                        sft,
+                                        MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
+                                        rsp,
+                                        TRUE,
+                                        "Illegal nb of values %d in %s (max %d)\n",
+                                        nb,
+                                        name,
+                                        MODBUS_MAX_READ_BITS);
+    } else if (mapping_address < 0 || (mapping_address + nb) > nb_bits) {
+        rsp_length = response_exception(ctx,
+                                        sft,
+                                        MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                                        rsp,
+                                        FALSE,
+                                        "Illegal data address 0x%0X in %s\n",
+                                        mapping_address < 0 ? address : address + nb,
+                                        name);
+    } else {
+        rsp_length = ctx->backend->build_response_basis(sft, rsp);
+        rsp[rsp_length++] = (nb / 8) + ((nb % 8) ? 1 : 0);
+        rsp_length =
+            response_io_status(tab_bits, mapping_address, nb, rsp, rsp_length);
+    }
+
+    return rsp_length;
+}
+
+static int reply_read_registers(modbus_t *ctx,
+                                const uint8_t *req,
+                                int req_length,
+                                uint8_t *rsp,
+                                sft_t *sft,
+                                modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const int function = sft->function;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    unsigned int is_input = (function == MODBUS_FC_READ_INPUT_REGISTERS);
+    int start_registers =
+        is_input ? mb_mapping->start_input_registers : mb_mapping->start_registers;
+    int nb_registers =
+        is_input ? mb_mapping->nb_input_registers : mb_mapping->nb_registers;
+    uint16_t *tab_registers =
+        is_input ? mb_mapping->tab_input_registers : mb_mapping->tab_registers;
+    const char *const name = is_input ? "read_input_registers" : "read_registers";
+    int nb = (req[offset + 3] << 8) + req[offset + 4];
+    /* The mapping can be shifted to reduce memory consumption and it
+       doesn't always start at address zero. */
+    int mapping_address = address - start_registers;
+
+    (void) req_length;
+
+    if (nb < 1 || MODBUS_MAX_READ_REGISTERS < nb) {
+        rsp_length = response_exception(ctx,
+                                        sft,
+                                        MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
+                                        rsp,
+                                        TRUE,
+                                        "Illegal nb of values %d in %s (max %d)\n",
+                                        nb,
+                                        name,
+                                        MODBUS_MAX_READ_REGISTERS);
+    } else if (mapping_address < 0 || (mapping_address + nb) > nb_registers) {
+        rsp_length = response_exception(ctx,
+                                        sft,
+                                        MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                                        rsp,
+                                        FALSE,
+                                        "Illegal data address 0x%0X in %s\n",
+                                        mapping_address < 0 ? address : address + nb,
+                                        name);
+    } else {
+        rsp_length = ctx->backend->build_response_basis(sft, rsp);
+        rsp[rsp_length++] = nb << 1;
+        modbus_encode_registers(rsp + rsp_length, tab_registers + mapping_address, nb);
+        rsp_length += nb << 1;
+    }
+
+    return rsp_length;
+}
+
+static int reply_write_bit(modbus_t *ctx,
+                           const uint8_t *req,
+                           int req_length,
+                           uint8_t *rsp,
+                           sft_t *sft,
+                           modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    int mapping_address = address - mb_mapping->start_bits;
+
+    if (mapping_address < 0 || mapping_address >= mb_mapping->nb_bits) {
+        rsp_length = response_exception(ctx,
+                                        sft,
+                                        MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                                        rsp,
+                                        FALSE,
+                                        "Illegal data address 0x%0X in write_bit\n",
+                                        address);
+    } else {
+        int data = (req[offset + 3] << 8) + req[offset + 4];
+
+        if (data == 0xFF00 || data == 0x0) {
+            mb_mapping->tab_bits[mapping_address] = data ? ON : OFF;
+            memcpy(rsp, req, req_length);
+            rsp_length = req_length;
+        } else {
+            rsp_length = response_exception(
+                ctx,
+                sft,
+                MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
+                rsp,
+                FALSE,
+                "Illegal data value 0x%0X in write_bit request at address %0X\n",
+                data,
+                address);
+        }
+    }
+
+    return rsp_length;
+}
+
+static int reply_write_register(modbus_t *ctx,
+                                const uint8_t *req,
+                                int req_length,
+                                uint8_t *rsp,
+                                sft_t *sft,
+                                modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    int mapping_address = address - mb_mapping->start_registers;
+
+    if (mapping_address < 0 || mapping_address >= mb_mapping->nb_registers) {
+        rsp_length =
+            response_exception(ctx,
+                               sft,
+                               MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                               rsp,
+                               FALSE,
+                               "Illegal data address 0x%0X in write_register\n",
+                               address);
+    } else {
+        int data = (req[offset + 3] << 8) + req[offset + 4];
+
+        mb_mapping->tab_registers[mapping_address] = data;
+        memcpy(rsp, req, req_length);
+        rsp_length = req_length;
+    }
+
+    return rsp_length;
+}
+
+static int reply_write_bits(modbus_t *ctx,
+                            const uint8_t *req,
+                            int req_length,
+                            uint8_t *rsp,
+                            sft_t *sft,
+                            modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    int nb = (req[offset + 3] << 8) + req[offset + 4];
+    int nb_bits = req[offset + 5];
+    int mapping_address = address - mb_mapping->start_bits;
+
+    (void) req_length;
+
+    if (nb < 1 || MODBUS_MAX_WRITE_BITS < nb || nb_bits * 8 < nb) {
+        /* May be the indication has been truncated on reading because of
+         * invalid address (eg. nb is 0 but the request contains values to
+         * write) so it's necessary to flush. */
+        rsp_length =
+            response_exception(ctx,
+                               sft,
+                               MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
+                               rsp,
+                               TRUE,
+                               "Illegal number of values %d in write_bits (max %d)\n",
+                               nb,
+                               MODBUS_MAX_WRITE_BITS);
+    } else if (mapping_address < 0 || (mapping_address + nb) > mb_mapping->nb_bits) {
+        rsp_length = response_exception(ctx,
+                                        sft,
+                                        MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                                        rsp,
+                                        FALSE,
+                                        "Illegal data address 0x%0X in write_bits\n",
+                                        mapping_address < 0 ? address : address + nb);
+    } else {
+        /* 6 = byte count */
+        modbus_set_bits_from_bytes(
+            mb_mapping->tab_bits, mapping_address, nb, &req[offset + 6]);
+
+        rsp_length = ctx->backend->build_response_basis(sft, rsp);
+        /* 4 to copy the bit address (2) and the quantity of bits */
+        memcpy(rsp + rsp_length, req + rsp_length, 4);
+        rsp_length += 4;
+    }
+
+    return rsp_length;
+}
+
+static int reply_write_registers(modbus_t *ctx,
+                                 const uint8_t *req,
+                                 int req_length,
+                                 uint8_t *rsp,
+                                 sft_t *sft,
+                                 modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    int nb = (req[offset + 3] << 8) + req[offset + 4];
+    int nb_bytes = req[offset + 5];
+    int mapping_address = address - mb_mapping->start_registers;
+
+    (void) req_length;
+
+    if (nb < 1 || MODBUS_MAX_WRITE_REGISTERS < nb || nb_bytes != nb * 2) {
+        rsp_length = response_exception(
+            ctx,
+            sft,
+            MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
+            rsp,
+            TRUE,
+            "Illegal number of values %d in write_registers (max %d)\n",
+            nb,
+            MODBUS_MAX_WRITE_REGISTERS);
+    } else if (mapping_address < 0 ||
+               (mapping_address + nb) > mb_mapping->nb_registers) {
+        rsp_length =
+            response_exception(ctx,
+                               sft,
+                               MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                               rsp,
+                               FALSE,
+                               "Illegal data address 0x%0X in write_registers\n",
+                               mapping_address < 0 ? address : address + nb);
+    } else {
+        /* 6 and 7 = first value */
+        modbus_decode_registers(
+            mb_mapping->tab_registers + mapping_address, req + offset + 6, nb);
+
+        rsp_length = ctx->backend->build_response_basis(sft, rsp);
+        /* 4 to copy the address (2) and the no. of registers */
+        memcpy(rsp + rsp_length, req + rsp_length, 4);
+        rsp_length += 4;
+    }
+
+    return rsp_length;
+}
+
+static int reply_report_slave_id(modbus_t *ctx,
+                                 const uint8_t *req,
+                                 int req_length,
+                                 uint8_t *rsp,
+                                 sft_t *sft,
+                                 modbus_mapping_t *mb_mapping)
+{
+    int rsp_length;
+    int str_len;
+    int byte_count_pos;
+
+    (void) req;
+    (void) req_length;
+    (void) mb_mapping;
+
+    rsp_length = ctx->backend->build_response_basis(sft, rsp);
+    /* Skip byte count for now */
+    byte_count_pos = rsp_length++;
+    rsp[rsp_length++] = _REPORT_SLAVE_ID;
+    /* Run indicator status to ON */
+    rsp[rsp_length++] = 0xFF;
+    /* LMB + length of LIBMODBUS_VERSION_STRING */
+    str_len = 3 + strlen(LIBMODBUS_VERSION_STRING);
+    memcpy(rsp + rsp_length, "LMB" LIBMODBUS_VERSION_STRING, str_len);
+    rsp_length += str_len;
+    rsp[byte_count_pos] = rsp_length - byte_count_pos - 1;
+
+    return rsp_length;
+}
+
+static int reply_read_exception_status(modbus_t *ctx,
+                                       const uint8_t *req,
+                                       int req_length,
+                                       uint8_t *rsp,
+                                       sft_t *sft,
+                                       modbus_mapping_t *mb_mapping)
+{
+    (void) req;
+    (void) req_length;
+    (void) rsp;
+    (void) sft;
+    (void) mb_mapping;
+
+    if (ctx->debug) {
+        fprintf(stderr, "FIXME Not implemented\n");
+    }
+    errno = ENOPROTOOPT;
+    return -1;
+}
+
+static int reply_mask_write_register(modbus_t *ctx,
+                                     const uint8_t *req,
+                                     int req_length,
+                                     uint8_t *rsp,
+                                     sft_t *sft,
+                                     modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    int mapping_address = address - mb_mapping->start_registers;
+
+    if (mapping_address < 0 || mapping_address >= mb_mapping->nb_registers) {
+        rsp_length =
+            response_exception(ctx,
+                               sft,
+                               MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+                               rsp,
+                               FALSE,
+                               "Illegal data address 0x%0X in write_register\n",
+                               address);
+    } else {
+        uint16_t data = mb_mapping->tab_registers[mapping_address];
+        uint16_t and = (req[offset + 3] << 8) + req[offset + 4];
+        uint16_t or = (req[offset + 5] << 8) + req[offset + 6];
+
+        data = (data & and) | (or &(~and));
+        mb_mapping->tab_registers[mapping_address] = data;
+        memcpy(rsp, req, req_length);
+        rsp_length = req_length;
+    }
+
+    return rsp_length;
+}
+
+static int reply_write_and_read_registers(modbus_t *ctx,
+                                          const uint8_t *req,
+                                          int req_length,
+                                          uint8_t *rsp,
+                                          sft_t *sft,
+                                          modbus_mapping_t *mb_mapping)
+{
+    const unsigned int offset = ctx->backend->header_length;
+    const uint16_t address = (req[offset + 1] << 8) + req[offset + 2];
+    int rsp_length;
+
+    int nb = (req[offset + 3] << 8) + req[offset + 4];
+    uint16_t address_write = (req[offset + 5] << 8) + req[offset + 6];
+    int nb_write = (req[offset + 7] << 8) + req[offset + 8];
+    int nb_write_bytes = req[offset + 9];
+    int mapping_address = address - mb_mapping->start_registers;
+    int mapping_address_write = address_write - mb_mapping->start_registers;
+
+    (void) req_length;
+
+    if (nb_write < 1 || MODBUS_MAX_WR_WRITE_REGISTERS < nb_write || nb < 1 ||
+        MODBUS_MAX_WR_READ_REGISTERS < nb || nb_write_bytes != nb_write * 2) {
+        rsp_length = response_exception(
+            ctx,
+            sft,
+            MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
+            rsp,
+            TRUE,
+            "Illegal nb of values (W%d, R%d) in write_and_read_registers (max W%d, "
+            "R%d)\n",
+            nb_write,
+            nb,
+            MODBUS_MAX_WR_WRITE_REGISTERS,
+            MODBUS_MAX_WR_READ_REGISTERS);
+    } else if (mapping_address < 0 ||
+               (mapping_address + nb) > mb_mapping->nb_registers ||
+               mapping_address_write < 0 ||
+               (mapping_address_write + nb_write) > mb_mapping->nb_registers) {
+        rsp_length = response_exception(
+            ctx,
+            sft,
+            MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
+            rsp,
+            FALSE,
+            "Illegal data read address 0x%0X or write address 0x%0X "
+            "write_and_read_registers\n",
+            mapping_address < 0 ? address : address + nb,
+            mapping_address_write < 0 ? address_write : address_write + nb_write);
+    } else {
+        rsp_length = ctx->backend->build_response_basis(sft, rsp);
+        rsp[rsp_length++] = nb << 1;
+
+        /* Write first.
+           10 and 11 are the offset of the first values to write */
+        modbus_decode_registers(
+            mb_mapping->tab_registers + mapping_address_write, req + offset + 10, nb_write);
+
+        /* and read the data for the response */
+        modbus_encode_registers(
+            rsp + rsp_length, mb_mapping->tab_registers + mapping_address, nb);
+        rsp_length += nb << 1;
+    }
+
+    return rsp_length;
+}
+
+/* Default behaviour of each function code, the data are flushed on illegal
+   number of values errors */
+static const reply_fn_t default_reply[_MODBUS_MAX_FUNCTION_CODE + 1] = {
+    [MODBUS_FC_READ_COILS] = reply_read_bits,
+    [MODBUS_FC_READ_DISCRETE_INPUTS] = reply_read_bits,
+    [MODBUS_FC_READ_HOLDING_REGISTERS] = reply_read_registers,
+    [MODBUS_FC_READ_INPUT_REGISTERS] = reply_read_registers,
+    [MODBUS_FC_WRITE_SINGLE_COIL] = reply_write_bit,
+    [MODBUS_FC_WRITE_SINGLE_REGISTER] = reply_write_register,
+    [MODBUS_FC_WRITE_MULTIPLE_COILS] = reply_write_bits,
+    [MODBUS_FC_WRITE_MULTIPLE_REGISTERS] = reply_write_registers,
+    [MODBUS_FC_REPORT_SLAVE_ID] = reply_report_slave_id,
+    [MODBUS_FC_READ_EXCEPTION_STATUS] = reply_read_exception_status,
+    [MODBUS_FC_MASK_WRITE_REGISTER] = reply_mask_write_register,
+    [MODBUS_FC_WRITE_AND_READ_REGISTERS] = reply_write_and_read_registers,
+};
+
+/* Calls the handler registered in the reply table of the context. The
+   response basis (header and function code) is built here so the handler only
+   writes the data of the PDU, straight into the response buffer. */
+static int reply_custom(modbus_t *ctx,
+                        const uint8_t *req,
+                        int req_length,
+                        uint8_t *rsp,
+                        sft_t *sft,
+                        modbus_mapping_t *mb_mapping)
+{
+    const modbus_reply_entry_t *entry = &ctx->reply_table->entries[sft->function];
+    int rsp_length = ctx->backend->build_response_basis(sft, rsp);
+    int rc = entry->handler(ctx, req, req_length, rsp + rsp_length, mb_mapping, entry->user_data);
+
+    if (rc < 0) {
+        if (-rc >= MODBUS_EXCEPTION_MAX) {
+            errno = EINVAL;
+            return -1;
+        }
+        return response_exception(ctx,
+                                  sft,
+                                  -rc,
+                                  rsp,
+                                  FALSE,
+                                  "Exception %d from the handler of function 0x%0X\n",
+                                  -rc,
+                                  sft->function);
+    }
+    if (rc > MODBUS_MAX_PDU_LENGTH - 1) {
+        errno = EMBBADDATA;
+        return -1;
+    }
+
+    return rsp_length + rc;
+}
+
 /* Send a response to the received request.
    Analyses the request and constructs a response.
 
@@ -782,9 +1347,8 @@ int modbus_reply(modbus_t *ctx,
     unsigned int offset;
     int slave;
     int function;
-    uint16_t address;
     uint8_t rsp[MAX_MESSAGE_LENGTH];
-    int rsp_length = 0;
+    int rsp_length;
     sft_t sft;
 
     if (ctx == NULL) {
@@ -795,328 +1359,17 @@ int modbus_reply(modbus_t *ctx,
     offset = ctx->backend->header_length;
     slave = req[offset - 1];
     function = req[offset];
-    address = (req[offset + 1] << 8) + req[offset + 2];
 
     sft.slave = slave;
     sft.function = function;
     sft.t_id = ctx->backend->prepare_response_tid(req, &req_length);
 
-    /* Data are flushed on illegal number of values errors. */
-    switch (function) {
-    case MODBUS_FC_READ_COILS:
-    case MODBUS_FC_READ_DISCRETE_INPUTS: {
-        unsigned int is_input = (function == MODBUS_FC_READ_DISCRETE_INPUTS);
-        int start_bits = is_input ? mb_mapping->start_input_bits : mb_mapping->start_bits;
-        int nb_bits = is_input ? mb_mapping->nb_input_bits : mb_mapping->nb_bits;
-        uint8_t *tab_bits = is_input ? mb_mapping->tab_input_bits : mb_mapping->tab_bits;
-        const char *const name = is_input ? "read_input_bits" : "read_bits";
-        int nb = (req[offset + 3] << 8) + req[offset + 4];
-        /* The mapping can be shifted to reduce memory consumption and it
-           doesn't always start at address zero. */
-        int mapping_address = address - start_bits;
-
-        if (nb < 1 || MODBUS_MAX_READ_BITS < nb) {
-            rsp_length = response_exception(ctx,
-                                            &sft,
-                                            MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
-                                            rsp,
-                                            TRUE,
-                                            "Illegal nb of values %d in %s (max %d)\n",
-                                            nb,
-                                            name,
-                                            MODBUS_MAX_READ_BITS);
-        } else if (mapping_address < 0 || (mapping_address + nb) > nb_bits) {
-            rsp_length = response_exception(ctx,
-                                            &sft,
-                                            MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                            rsp,
-                                            FALSE,
-                                            "Illegal data address 0x%0X in %s\n",
-                                            mapping_address < 0 ? address : address + nb,
-                                            name);
-        } else {
-            rsp_length = ctx->backend->build_response_basis(&sft, rsp);
-            rsp[rsp_length++] = (nb / 8) + ((nb % 8) ? 1 : 0);
-            rsp_length =
-                response_io_status(tab_bits, mapping_address, nb, rsp, rsp_length);
-        }
-    } break;
-    case MODBUS_FC_READ_HOLDING_REGISTERS:
-    case MODBUS_FC_READ_INPUT_REGISTERS: {
-        unsigned int is_input = (function == MODBUS_FC_READ_INPUT_REGISTERS);
-        int start_registers =
-            is_input ? mb_mapping->start_input_registers : mb_mapping->start_registers;
-        int nb_registers =
-            is_input ? mb_mapping->nb_input_registers : mb_mapping->nb_registers;
-        uint16_t *tab_registers =
-            is_input ? mb_mapping->tab_input_registers : mb_mapping->tab_registers;
-        const char *const name = is_input ? "read_input_registers" : "read_registers";
-        int nb = (req[offset + 3] << 8) + req[offset + 4];
-        /* The mapping can be shifted to reduce memory consumption and it
-           doesn't always start at address zero. */
-        int mapping_address = address - start_registers;
-
-        if (nb < 1 || MODBUS_MAX_READ_REGISTERS < nb) {
-            rsp_length = response_exception(ctx,
-                                            &sft,
-                                            MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
-                                            rsp,
-                                            TRUE,
-                                            "Illegal nb of values %d in %s (max %d)\n",
-                                            nb,
-                                            name,
-                                            MODBUS_MAX_READ_REGISTERS);
-        } else if (mapping_address < 0 || (mapping_address + nb) > nb_registers) {
-            rsp_length = response_exception(ctx,
-                                            &sft,
-                                            MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                            rsp,
-                                            FALSE,
-                                            "Illegal data address 0x%0X in %s\n",
-                                            mapping_address < 0 ? address : address + nb,
-                                            name);
-        } else {
-            int i;
-
-            rsp_length = ctx->backend->build_response_basis(&sft, rsp);
-            rsp[rsp_length++] = nb << 1;
-            for (i = mapping_address; i < mapping_address + nb; i++) {
-                rsp[rsp_length++] = tab_registers[i] >> 8;
-                rsp[rsp_length++] = tab_registers[i] & 0xFF;
-            }
-        }
-    } break;
-    case MODBUS_FC_WRITE_SINGLE_COIL: {
-        int mapping_address = address - mb_mapping->start_bits;
-
-        if (mapping_address < 0 || mapping_address >= mb_mapping->nb_bits) {
-            rsp_length = response_exception(ctx,
-                                            &sft,
-                                            MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                            rsp,
-                                            FALSE,
-                                            "Illegal data address 0x%0X in write_bit\n",
-                                            address);
-        } else {
-            int data = (req[offset + 3] << 8) + req[offset + 4];
-
-            if (data == 0xFF00 || data == 0x0) {
-                mb_mapping->tab_bits[mapping_address] = data ? ON : OFF;
-                memcpy(rsp, req, req_length);
-                rsp_length = req_length;
-            } else {
-                rsp_length = response_exception(
-                    ctx,
-                    &sft,
-                    MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
-                    rsp,
-                    FALSE,
-                    "Illegal data value 0x%0X in write_bit request at address %0X\n",
-                    data,
-                    address);
-            }
-        }
-    } break;
-    case MODBUS_FC_WRITE_SINGLE_REGISTER: {
-        int mapping_address = address - mb_mapping->start_registers;
-
-        if (mapping_address < 0 || mapping_address >= mb_mapping->nb_registers) {
-            rsp_length =
-                response_exception(ctx,
-                                   &sft,
-                                   MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                   rsp,
-                                   FALSE,
-                                   "Illegal data address 0x%0X in write_register\n",
-                                   address);
-        } else {
-            int data = (req[offset + 3] << 8) + req[offset + 4];
-
-            mb_mapping->tab_registers[mapping_address] = data;
-            memcpy(rsp, req, req_length);
-            rsp_length = req_length;
-        }
-    } break;
-    case MODBUS_FC_WRITE_MULTIPLE_COILS: {
-        int nb = (req[offset + 3] << 8) + req[offset + 4];
-        int nb_bits = req[offset + 5];
-        int mapping_address = address - mb_mapping->start_bits;
-
-        if (nb < 1 || MODBUS_MAX_WRITE_BITS < nb || nb_bits * 8 < nb) {
-            /* May be the indication has been truncated on reading because of
-             * invalid address (eg. nb is 0 but the request contains values to
-             * write) so it's necessary to flush. */
-            rsp_length =
-                response_exception(ctx,
-                                   &sft,
-                                   MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
-                                   rsp,
-                                   TRUE,
-                                   "Illegal number of values %d in write_bits (max %d)\n",
-                                   nb,
-                                   MODBUS_MAX_WRITE_BITS);
-        } else if (mapping_address < 0 || (mapping_address + nb) > mb_mapping->nb_bits) {
-            rsp_length = response_exception(ctx,
-                                            &sft,
-                                            MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                            rsp,
-                                            FALSE,
-                                            "Illegal data address 0x%0X in write_bits\n",
-                                            mapping_address < 0 ? address : address + nb);
-        } else {
-            /* 6 = byte count */
-            modbus_set_bits_from_bytes(
-                mb_mapping->tab_bits, mapping_address, nb, &req[offset + 6]);
-
-            rsp_length = ctx->backend->build_response_basis(&sft, rsp);
-            /* 4 to copy the bit address (2) and the quantity of bits */
-            memcpy(rsp + rsp_length, req + rsp_length, 4);
-            rsp_length += 4;
-        }
-    } break;
-    case MODBUS_FC_WRITE_MULTIPLE_REGISTERS: {
-        int nb = (req[offset + 3] << 8) + req[offset + 4];
-        int nb_bytes = req[offset + 5];
-        int mapping_address = address - mb_mapping->start_registers;
-
-        if (nb < 1 || MODBUS_MAX_WRITE_REGISTERS < nb || nb_bytes != nb * 2) {
-            rsp_length = response_exception(
-                ctx,
-                &sft,
-                MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
-                rsp,
-                TRUE,
-                "Illegal number of values %d in write_registers (max %d)\n",
-                nb,
-                MODBUS_MAX_WRITE_REGISTERS);
-        } else if (mapping_address < 0 ||
-                   (mapping_address + nb) > mb_mapping->nb_registers) {
-            rsp_length =
-                response_exception(ctx,
-                                   &sft,
-                                   MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                   rsp,
-                                   FALSE,
-                                   "Illegal data address 0x%0X in write_registers\n",
-                                   mapping_address < 0 ? address : address + nb);
-        } else {
-            int i, j;
-            for (i = mapping_address, j = 6; i < mapping_address + nb; i++, j += 2) {
-                /* 6 and 7 = first value */
-                mb_mapping->tab_registers[i] =
-                    (req[offset + j] << 8) + req[offset + j + 1];
-            }
-
-            rsp_length = ctx->backend->build_response_basis(&sft, rsp);
-            /* 4 to copy the address (2) and the no. of registers */
-            memcpy(rsp + rsp_length, req + rsp_length, 4);
-            rsp_length += 4;
-        }
-    } break;
-    case MODBUS_FC_REPORT_SLAVE_ID: {
-        int str_len;
-        int byte_count_pos;
-
-        rsp_length = ctx->backend->build_response_basis(&sft, rsp);
-        /* Skip byte count for now */
-        byte_count_pos = rsp_length++;
-        rsp[rsp_length++] = _REPORT_SLAVE_ID;
-        /* Run indicator status to ON */
-        rsp[rsp_length++] = 0xFF;
-        /* LMB + length of LIBMODBUS_VERSION_STRING */
-        str_len = 3 + strlen(LIBMODBUS_VERSION_STRING);
-        memcpy(rsp + rsp_length, "LMB" LIBMODBUS_VERSION_STRING, str_len);
-        rsp_length += str_len;
-        rsp[byte_count_pos] = rsp_length - byte_count_pos - 1;
-    } break;
-    case MODBUS_FC_READ_EXCEPTION_STATUS:
-        if (ctx->debug) {
-            fprintf(stderr, "FIXME Not implemented\n");
-        }
-        errno = ENOPROTOOPT;
-        return -1;
-        break;
-    case MODBUS_FC_MASK_WRITE_REGISTER: {
-        int mapping_address = address - mb_mapping->start_registers;
-
-        if (mapping_address < 0 || mapping_address >= mb_mapping->nb_registers) {
-            rsp_length =
-                response_exception(ctx,
-                                   &sft,
-                                   MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                                   rsp,
-                                   FALSE,
-                                   "Illegal data address 0x%0X in write_register\n",
-                                   address);
-        } else {
-            uint16_t data = mb_mapping->tab_registers[mapping_address];
-            uint16_t and = (req[offset + 3] << 8) + req[offset + 4];
-            uint16_t or = (req[offset + 5] << 8) + req[offset + 6];
-
-            data = (data & and) | (or &(~and));
-            mb_mapping->tab_registers[mapping_address] = data;
-            memcpy(rsp, req, req_length);
-            rsp_length = req_length;
-        }
-    } break;
-    case MODBUS_FC_WRITE_AND_READ_REGISTERS: {
-        int nb = (req[offset + 3] << 8) + req[offset + 4];
-        uint16_t address_write = (req[offset + 5] << 8) + req[offset + 6];
-        int nb_write = (req[offset + 7] << 8) + req[offset + 8];
-        int nb_write_bytes = req[offset + 9];
-        int mapping_address = address - mb_mapping->start_registers;
-        int mapping_address_write = address_write - mb_mapping->start_registers;
-
-        if (nb_write < 1 || MODBUS_MAX_WR_WRITE_REGISTERS < nb_write || nb < 1 ||
-            MODBUS_MAX_WR_READ_REGISTERS < nb || nb_write_bytes != nb_write * 2) {
-            rsp_length = response_exception(
-                ctx,
-                &sft,
-                MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE,
-                rsp,
-                TRUE,
-                "Illegal nb of values (W%d, R%d) in write_and_read_registers (max W%d, "
-                "R%d)\n",
-                nb_write,
-                nb,
-                MODBUS_MAX_WR_WRITE_REGISTERS,
-                MODBUS_MAX_WR_READ_REGISTERS);
-        } else if (mapping_address < 0 ||
-                   (mapping_address + nb) > mb_mapping->nb_registers ||
-                   mapping_address_write < 0 ||
-                   (mapping_address_write + nb_write) > mb_mapping->nb_registers) {
-            rsp_length = response_exception(
-                ctx,
-                &sft,
-                MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS,
-                rsp,
-                FALSE,
-                "Illegal data read address 0x%0X or write address 0x%0X "
-                "write_and_read_registers\n",
-                mapping_address < 0 ? address : address + nb,
-                mapping_address_write < 0 ? address_write : address_write + nb_write);
-        } else {
-            int i, j;
-            rsp_length = ctx->backend->build_response_basis(&sft, rsp);
-            rsp[rsp_length++] = nb << 1;
-
-            /* Write first.
-               10 and 11 are the offset of the first values to write */
-            for (i = mapping_address_write, j = 10; i < mapping_address_write + nb_write;
-                 i++, j += 2) {
-                mb_mapping->tab_registers[i] =
-                    (req[offset + j] << 8) + req[offset + j + 1];
-            }
-
-            /* and read the data for the response */
-            for (i = mapping_address; i < mapping_address + nb; i++) {
-                rsp[rsp_length++] = mb_mapping->tab_registers[i] >> 8;
-                rsp[rsp_length++] = mb_mapping->tab_registers[i] & 0xFF;
-            }
-        }
-    } break;
-
-    default:
+    if (function <= _MODBUS_MAX_FUNCTION_CODE && ctx->reply_table != NULL &&
+        ctx->reply_table->entries[function].handler != NULL) {
+        rsp_length = reply_custom(ctx, req, req_length, rsp, &sft, mb_mapping);
+    } else if (function <= _MODBUS_MAX_FUNCTION_CODE && default_reply[function] != NULL) {
+        rsp_length = default_reply[function](ctx, req, req_length, rsp, &sft, mb_mapping);
+    } else {
         rsp_length = response_exception(ctx,
                                         &sft,
                                         MODBUS_EXCEPTION_ILLEGAL_FUNCTION,
@@ -1124,7 +1377,10 @@ int modbus_reply(modbus_t *ctx,
                                         TRUE,
                                         "Unknown Modbus function code: 0x%0X\n",
                                         function);
-        break;
+    }
+
+    if (rsp_length == -1) {
+        return -1;
     }
 
     /* Suppress any responses in RTU when the request was a broadcast, excepted when quirk
@@ -1171,6 +1427,79 @@ int modbus_reply_exception(modbus_t *ctx, const uint8_t *req, unsigned int excep
     }
 }
 
+/* Sends a response built by the caller, eg. forwarded from another bus by a
+   gateway. raw_rsp holds the slave and the PDU like modbus_send_raw_request();
+   the header (transaction ID on TCP) is taken from the indication req of
+   req_length bytes, as returned by modbus_receive(). */
+int modbus_reply_raw(modbus_t *ctx,
+                     const uint8_t *req,
+                     int req_length,
+                     const uint8_t *raw_rsp,
+                     int raw_rsp_length)
+{
+    uint8_t rsp[MAX_MESSAGE_LENGTH];
+    int rsp_length;
+    sft_t sft;
+
+    if (ctx == NULL || req == NULL || req_length < (int) ctx->backend->header_length ||
+        raw_rsp_length < 2 || raw_rsp_length > (MODBUS_MAX_PDU_LENGTH + 1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sft.slave = raw_rsp[0];
+    sft.function = raw_rsp[1];
+    sft.t_id = ctx->backend->prepare_response_tid(req, &req_length);
+    rsp_length = ctx->backend->build_response_basis(&sft, rsp);
+
+    /* The function code is already in the header */
+    memcpy(rsp + rsp_length, raw_rsp + 2, raw_rsp_length - 2);
+    rsp_length += raw_rsp_length - 2;
+
+    return send_msg(ctx, rsp, rsp_length);
+}
+
+modbus_reply_table_t *modbus_reply_table_new(void)
+{
+    modbus_reply_table_t *table = (modbus_reply_table_t *) calloc(1, sizeof(*table));
+
+    if (table == NULL) {
+        errno = ENOMEM;
+    }
+    return table;
+}
+
+void modbus_reply_table_free(modbus_reply_table_t *table)
+{
+    free(table);
+}
+
+int modbus_reply_table_set(modbus_reply_table_t *table,
+                           int function,
+                           modbus_reply_handler_t handler,
+                           void *user_data)
+{
+    if (table == NULL || function < 1 || function > _MODBUS_MAX_FUNCTION_CODE) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    table->entries[function].handler = handler;
+    table->entries[function].user_data = handler != NULL ? user_data : NULL;
+    return 0;
+}
+
+int modbus_set_reply_table(modbus_t *ctx, const modbus_reply_table_t *table)
+{
+    if (ctx == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ctx->reply_table = table;
+    return 0;
+}
+
 /* Reads IO status */
 static int read_io_status(modbus_t *ctx, int function, int addr, int nb, uint8_t *dest)
 {
@@ -1296,7 +1625,6 @@ static int read_registers(modbus_t *ctx, int function, int addr, int nb, uint16_
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
         unsigned int offset;
-        int i;
 
         rc = _modbus_receive_msg(ctx, rsp, MSG_CONFIRMATION);
         if (rc == -1)
@@ -1308,10 +1636,7 @@ static int read_registers(modbus_t *ctx, int function, int addr, int nb, uint16_
 
         offset = ctx->backend->header_length;
 
-        for (i = 0; i < rc; i++) {
-            /* shift reg hi_byte to temp OR with lo_byte */
-            dest[i] = (rsp[offset + 2 + (i << 1)] << 8) | rsp[offset + 3 + (i << 1)];
-        }
+        modbus_decode_registers(dest, rsp + offset + 2, rc);
     }
 
     return rc;
@@ -1486,7 +1811,6 @@ int modbus_write_bits(modbus_t *ctx, int addr, int nb, const uint8_t *src)
 int modbus_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *src)
 {
     int rc;
-    int i;
     int req_length;
     int byte_count;
     uint8_t req[MAX_MESSAGE_LENGTH];
@@ -1512,10 +1836,8 @@ int modbus_write_registers(modbus_t *ctx, int addr, int nb, const uint16_t *src)
     byte_count = nb * 2;
     req[req_length++] = byte_count;
 
-    for (i = 0; i < nb; i++) {
-        req[req_length++] = src[i] >> 8;
-        req[req_length++] = src[i] & 0x00FF;
-    }
+    modbus_encode_registers(req + req_length, src, nb);
+    req_length += byte_count;
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
@@ -1582,7 +1904,6 @@ int modbus_write_and_read_registers(modbus_t *ctx,
 {
     int rc;
     int req_length;
-    int i;
     int byte_count;
     uint8_t req[MAX_MESSAGE_LENGTH];
     uint8_t rsp[MAX_MESSAGE_LENGTH];
@@ -1623,10 +1944,8 @@ int modbus_write_and_read_registers(modbus_t *ctx,
     byte_count = write_nb * 2;
     req[req_length++] = byte_count;
 
-    for (i = 0; i < write_nb; i++) {
-        req[req_length++] = src[i] >> 8;
-        req[req_length++] = src[i] & 0x00FF;
-    }
+    modbus_encode_registers(req + req_length, src, write_nb);
+    req_length += byte_count;
 
     rc = send_msg(ctx, req, req_length);
     if (rc > 0) {
@@ -1641,10 +1960,7 @@ int modbus_write_and_read_registers(modbus_t *ctx,
             return -1;
 
         offset = ctx->backend->header_length;
-        for (i = 0; i < rc; i++) {
-            /* shift reg hi_byte to temp OR with lo_byte */
-            dest[i] = (rsp[offset + 2 + (i << 1)] << 8) | rsp[offset + 3 + (i << 1)];
-        }
+        modbus_decode_registers(dest, rsp + offset + 2, rc);
     }
 
     return rc;
@@ -1713,6 +2029,9 @@ void _modbus_init_common(modbus_t *ctx)
 
     ctx->indication_timeout.tv_sec = 0;
     ctx->indication_timeout.tv_usec = 0;
+
+    ctx->flush_pending = FALSE;
+    ctx->reply_table = NULL;
 }
 
 /* Define the slave number */
@@ -1857,6 +2176,17 @@ int modbus_get_header_length(modbus_t *ctx)
     return ctx->backend->header_length;
 }
 
+int modbus_get_indication_length(modbus_t *ctx, const uint8_t *req, int req_length)
+{
+    if (ctx == NULL || req == NULL || req_length < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Only reads the bytes below the returned length */
+    return _modbus_expected_length(ctx, (uint8_t *) req, req_length, MSG_INDICATION);
+}
+
 int modbus_enable_quirks(modbus_t *ctx, unsigned int quirks_mask)
 {
     if (ctx == NULL) {
@@ -206,6 +206,12 @@ MODBUS_API int
 modbus_set_indication_timeout(modbus_t *ctx, uint32_t to_sec, uint32_t to_usec);
 
 MODBUS_API int modbus_get_header_length(modbus_t *ctx);
+/* Length of the indication req implied by its function code, header and
+   checksum included, or 0 when req_length is too short to tell. A server
+   that frames the indications itself (eg. by the MBAP length) must not serve
+   one shorter than that. */
+MODBUS_API int
+modbus_get_indication_length(modbus_t *ctx, const uint8_t *req, int req_length);
 
 MODBUS_API int modbus_connect(modbus_t *ctx);
 MODBUS_API void modbus_close(modbus_t *ctx);
@@ -256,6 +262,8 @@ MODBUS_API void modbus_mapping_free(modbus_mapping_t *mb_mapping);
 
 MODBUS_API int
 modbus_send_raw_request(modbus_t *ctx, const uint8_t *raw_req, int raw_req_length);
+MODBUS_API int
+modbus_send_raw_request_tid(modbus_t *ctx, const uint8_t *raw_req, int raw_req_length);
 
 MODBUS_API int modbus_receive(modbus_t *ctx, uint8_t *req);
 
@@ -267,6 +275,39 @@ MODBUS_API int modbus_reply(modbus_t *ctx,
                             modbus_mapping_t *mb_mapping);
 MODBUS_API int
 modbus_reply_exception(modbus_t *ctx, const uint8_t *req, unsigned int exception_code);
+MODBUS_API int modbus_reply_raw(modbus_t *ctx,
+                                const uint8_t *req,
+                                int req_length,
+                                const uint8_t *raw_rsp,
+                                int raw_rsp_length);
+
+/* Server-side handler of a function code, called by modbus_reply() in place of
+   the default behaviour. req is the whole indication (see
+   modbus_get_header_length()) without checksum, rsp the data of the response
+   PDU right after the function code (MODBUS_MAX_PDU_LENGTH - 1 bytes at most).
+   Returns the number of bytes written to rsp, or a negative exception code
+   (eg. -MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS) to send an exception response.
+   On RTU an indication whose length can't be derived from the function code
+   ends at the t3.5 silent interval, so custom function codes may carry data
+   there too. */
+typedef int (*modbus_reply_handler_t)(modbus_t *ctx,
+                                      const uint8_t *req,
+                                      int req_length,
+                                      uint8_t *rsp,
+                                      modbus_mapping_t *mb_mapping,
+                                      void *user_data);
+typedef struct _modbus_reply_table modbus_reply_table_t;
+
+/* A table can be shared by many contexts (eg. all the connections of a
+   server), it must outlive them */
+MODBUS_API modbus_reply_table_t *modbus_reply_table_new(void);
+MODBUS_API void modbus_reply_table_free(modbus_reply_table_t *table);
+/* A NULL handler restores the default behaviour of the function code */
+MODBUS_API int modbus_reply_table_set(modbus_reply_table_t *table,
+                                      int function,
+                                      modbus_reply_handler_t handler,
+                                      void *user_data);
+MODBUS_API int modbus_set_reply_table(modbus_t *ctx, const modbus_reply_table_t *table);
 MODBUS_API int modbus_enable_quirks(modbus_t *ctx, unsigned int quirks_mask);
 MODBUS_API int modbus_disable_quirks(modbus_t *ctx, unsigned int quirks_mask);
 
@@ -309,6 +350,11 @@ MODBUS_API void modbus_set_bits_from_bytes(uint8_t *dest,
 MODBUS_API uint8_t modbus_get_byte_from_bits(const uint8_t *src,
                                              int idx,
                                              unsigned int nb_bits);
+/* Converts nb registers between host order and the big-endian byte order of
+   the Modbus frames (2 * nb bytes) */
+MODBUS_API void modbus_encode_registers(uint8_t *dest, const uint16_t *src, int nb);
+MODBUS_API void modbus_decode_registers(uint16_t *dest, const uint8_t *src, int nb);
+
 MODBUS_API float modbus_get_float(const uint16_t *src);
 MODBUS_API float modbus_get_float_abcd(const uint16_t *src);
 MODBUS_API float modbus_get_float_dcba(const uint16_t *src);
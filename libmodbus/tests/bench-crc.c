@@ -0,0 +1,62 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Times the CRC16 kernels of the RTU backend per frame length. The backend
+   is compiled in so its static kernels can be called directly. */
+
+#include "modbus-rtu.c"
+
+#include <time.h>
+
+#define TOTAL_BYTES (256 * 1000 * 1000)
+
+typedef uint16_t (*kernel_t)(uint16_t crc, const uint8_t *buffer, int length);
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_kernel(kernel_t kernel, const uint8_t *buffer, int length)
+{
+    int rounds = TOTAL_BYTES / length;
+    volatile uint16_t sink = 0;
+    double start;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < rounds; i++) {
+        /* Chained so the calls can't overlap or be hoisted */
+        sink = kernel(sink, buffer, length);
+    }
+    return (now_ns() - start) / rounds;
+}
+
+int main(void)
+{
+    static const int lengths[] = {8, 16, 64, 128, 256};
+    uint8_t buffer[MODBUS_RTU_MAX_ADU_LENGTH];
+    unsigned int i;
+
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = rand();
+    }
+
+    printf("%8s %16s %10s\n", "bytes", "slicing-by-8", "pclmul");
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        int length = lengths[i];
+
+        printf("%8d %13.1f ns", length, time_kernel(crc16_update, buffer, length));
+#if defined(MODBUS_CRC_CLMUL)
+        if (crc16_select() == crc16_pclmul) {
+            printf(" %7.1f ns", time_kernel(crc16_pclmul, buffer, length));
+        }
+#endif
+        printf("\n");
+    }
+    return 0;
+}
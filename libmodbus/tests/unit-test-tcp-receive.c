@@ -0,0 +1,116 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+/* Feeds raw indications to modbus_receive() on a TCP context through a
+   socket pair and checks how the MBAP slicing handles them. */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <modbus.h>
+
+#define ASSERT_TRUE(cond, msg)                                                  \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, msg);            \
+            goto close;                                                         \
+        }                                                                       \
+    } while (0)
+
+/* Write multiple registers at 0x0010, 2 registers, 4 bytes */
+static const uint8_t fc16_request[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x0B, 0x01, 0x10,
+                                       0x00, 0x10, 0x00, 0x02, 0x04, 0x12, 0x34, 0x56,
+                                       0x78};
+
+/* Read 2 holding registers at 0x0010 */
+static const uint8_t fc3_request[] = {
+    0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x10, 0x00, 0x02};
+
+static int send_frame(int s, const uint8_t *frame, int length)
+{
+    return send(s, frame, length, 0) == length ? 0 : -1;
+}
+
+/* Sends the FC16 request cut to mbap_length bytes after the length field,
+   with a consistent MBAP header */
+static int send_truncated_fc16(int s, int mbap_length)
+{
+    uint8_t frame[sizeof(fc16_request)];
+
+    memcpy(frame, fc16_request, sizeof(fc16_request));
+    frame[5] = mbap_length;
+    return send_frame(s, frame, 6 + mbap_length);
+}
+
+int main(void)
+{
+    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+    modbus_t *ctx;
+    int sv[2];
+    int failed = 1;
+    int rc;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        perror("socketpair");
+        return 1;
+    }
+
+    ctx = modbus_new_tcp("127.0.0.1", 1502);
+    if (ctx == NULL) {
+        perror("modbus_new_tcp");
+        return 1;
+    }
+    modbus_set_socket(ctx, sv[0]);
+    modbus_set_indication_timeout(ctx, 1, 0);
+
+    /* A complete request is returned as is */
+    ASSERT_TRUE(send_frame(sv[1], fc16_request, sizeof(fc16_request)) == 0, "send");
+    rc = modbus_receive(ctx, query);
+    ASSERT_TRUE(rc == (int) sizeof(fc16_request), "complete FC16 not received");
+    ASSERT_TRUE(memcmp(query, fc16_request, rc) == 0, "complete FC16 altered");
+
+    /* The byte count is announced but the values are missing */
+    ASSERT_TRUE(send_truncated_fc16(sv[1], 7) == 0, "send");
+    rc = modbus_receive(ctx, query);
+    ASSERT_TRUE(rc == -1 && errno == EMBBADDATA, "FC16 without values accepted");
+
+    /* Some of the values are missing */
+    ASSERT_TRUE(send_truncated_fc16(sv[1], 9) == 0, "send");
+    rc = modbus_receive(ctx, query);
+    ASSERT_TRUE(rc == -1 && errno == EMBBADDATA, "FC16 with half the values accepted");
+
+    /* Too short to read the byte count */
+    ASSERT_TRUE(send_truncated_fc16(sv[1], 4) == 0, "send");
+    rc = modbus_receive(ctx, query);
+    ASSERT_TRUE(rc == -1 && errno == EMBBADDATA, "FC16 without byte count accepted");
+
+    /* The truncated request is consumed, the next one in the same segment
+       is still delimited correctly */
+    {
+        uint8_t segment[sizeof(fc16_request) + sizeof(fc3_request)];
+
+        memcpy(segment, fc16_request, 6 + 7);
+        segment[5] = 7;
+        memcpy(segment + 6 + 7, fc3_request, sizeof(fc3_request));
+        ASSERT_TRUE(send_frame(sv[1], segment, 6 + 7 + sizeof(fc3_request)) == 0, "send");
+    }
+    rc = modbus_receive(ctx, query);
+    ASSERT_TRUE(rc == -1 && errno == EMBBADDATA, "pipelined short FC16 accepted");
+    ASSERT_TRUE(modbus_tcp_has_indication(ctx) == 1, "next request lost");
+    rc = modbus_receive(ctx, query);
+    ASSERT_TRUE(rc == (int) sizeof(fc3_request), "request after short FC16 not received");
+    ASSERT_TRUE(memcmp(query, fc3_request, rc) == 0, "request after short FC16 altered");
+
+    printf("unit-test-tcp-receive: OK\n");
+    failed = 0;
+
+close:
+    modbus_free(ctx);
+    close(sv[0]);
+    close(sv[1]);
+    return failed;
+}
@@ -1,9 +1,30 @@
 #include "mainwindow.h"
+#include "headless.h"
 
 #include <QApplication>
+#include <cstring>
 
 int main(int argc, char *argv[])
 {
+    // 无界面模式: ModbusSimulator --headless --config plant.json
+    bool headless = false;
+    std::string config;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc)
+        {
+            config = argv[++i];
+        }
+    }
+    if (headless)
+    {
+        return runHeadless(config);
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
@@ -77,6 +77,7 @@ void MainWindow::on_btnTcp_clicked()
         // 已经连接
         mListening = false;
         if(mModbusMode == ModbusMode::MASTER){
+            mAcquisition.stop();
             mMaster->close();
         }else{
             mSlave->close();
@@ -101,6 +102,7 @@ void MainWindow::on_btnTcp_clicked()
         if(master->open()){
             modifyConnectState(true);
             mMaster = master;
+            startAcquisition();
             ui->btnTcp->setText("断开");
             mListening = true;
             setConnectMode(ConnectMode::TCP);
@@ -149,6 +151,11 @@ void MainWindow::flushComList(){
 }
 
 
+// 串口名转换为系统设备路径: Windows为\\.\COMx, Linux为/dev/ttyXXX
+std::string MainWindow::comDevice() const{
+    return QSerialPortInfo(ui->cbxCom->currentText()).systemLocation().toStdString();
+}
+
 void MainWindow::on_cbxCom_textActivated(const QString &arg1)
 {
     if(arg1 == "刷新"){
@@ -162,6 +169,7 @@ void MainWindow::on_btnOpenCom_clicked()
     if(mConnecting){
         mConnecting = false;
         if(mModbusMode == ModbusMode::MASTER){
+            mAcquisition.stop();
             mMaster->close();
         }else{
             mSlave->close();
@@ -174,7 +182,7 @@ void MainWindow::on_btnOpenCom_clicked()
 
     if(mModbusMode == ModbusMode::MASTER){
         auto master = std::make_shared<ModbusMasterRtu>();
-        master->setTarget(ui->cbxCom->currentText().toStdString(),
+        master->setTarget(comDevice(),
                          ui->txtBaud->text().toUInt(),
                          ui->cbxParity->currentText().toStdString().at(0),
                          ui->cbxData->currentText().toUInt(),
@@ -184,6 +192,7 @@ void MainWindow::on_btnOpenCom_clicked()
         if(master->open()){
             modifyConnectState(true);
             mMaster = master;
+            startAcquisition();
             ui->btnOpenCom->setText("关闭串口");
             mConnecting = true;
             setConnectMode(ConnectMode::RTU);
@@ -194,7 +203,7 @@ void MainWindow::on_btnOpenCom_clicked()
         }
     }else{
         auto slave = std::make_shared<ModbusSlaveRTU>();
-        slave->setTarget(ui->cbxCom->currentText().toStdString(), ui->txtBaud->text().toUInt(),
+        slave->setTarget(comDevice(), ui->txtBaud->text().toUInt(),
                         ui->cbxParity->currentText().toStdString().at(0),
                         ui->cbxData->currentText().toUInt(), ui->cbxStop->currentText().toUInt());
         slave->setSlave(ui->txtSlaveId->text().toUInt());
@@ -231,16 +240,22 @@ void MainWindow::setSlaveConfig(){
         mSlaveAddr = addrstr.toUInt();
     }
 
+    if(mSlaveAddr > 0xFFFF){
+        mSlaveAddr = 0xFFFF;
+    }
     mSlaveRegisterCnt = ui->txtRegisterCnt->text().toInt();
-    if(mSlaveRegisterCnt > 100){
-        mSlaveRegisterCnt = 100;
-        ui->txtRegisterCnt->setText("100");
+    // 寄存器数量只受地址空间限制
+    if(mSlaveRegisterCnt > 0x10000 - mSlaveAddr){
+        mSlaveRegisterCnt = 0x10000 - mSlaveAddr;
+        ui->txtRegisterCnt->setText(QString::number(mSlaveRegisterCnt));
     }
     if(mSlaveRegisterCnt < 0){
         mSlaveRegisterCnt = 0;
         ui->txtRegisterCnt->setText("0");
     }
     mFuncode = ui->cbxFuncode->currentIndex() + 3;
+    // 范围变化后全部重读
+    mSlaveVersions.clear();
 }
 
 void MainWindow::on_btnConfirmConfig_clicked()
@@ -249,6 +264,10 @@ void MainWindow::on_btnConfirmConfig_clicked()
     if(ui->btnConfirmConfig->isChecked()){
         setSlaveConfig();
         mRegisterWin.setAddrAndCount(mSlaveAddr, mSlaveRegisterCnt);
+        if(mAcquisition.running()){
+            // 轮询参数在启动时拷贝, 配置变化后重新启动
+            startAcquisition();
+        }
     }
     for(auto conf : configs){
         conf->setEnabled(!ui->btnConfirmConfig->isChecked());
@@ -262,7 +281,11 @@ void MainWindow::writeRegister(int addr, int value){
     }
     if(mModbusMode == ModbusMode::MASTER){
         if(mMaster){
-            mMaster->writeRegister(addr, {val});
+            // 与轮询共用同一连接, 交给采集线程执行
+            auto master = mMaster;
+            mAcquisition.post([master, addr, val](){
+                master->writeRegister(addr, {val});
+            });
         }
     }else{
         if(mSlave){
@@ -278,6 +301,24 @@ void MainWindow::writeRegister(int addr, int value){
     }
 }
 
+void MainWindow::startAcquisition(){
+    auto master = mMaster;
+    // 超过单次读取上限时由轮询计划拆成多个请求, TCP下流水线发送
+    auto plan = std::make_shared<PollPlan>();
+    if(mSlaveRegisterCnt > 0){
+        plan->addTag({mFuncode, static_cast<unsigned int>(mSlaveAddr), static_cast<unsigned int>(mSlaveRegisterCnt)});
+    }
+    mAcquisition.start([master, plan](std::vector<uint16_t> &values){
+        auto results = plan->scan(*master);
+        if(results.empty()){
+            values.clear();
+        }else{
+            values = std::move(results.front());
+        }
+        return master->connected();
+    });
+}
+
 void MainWindow::flushDataTable(){
     if(!mConnecting && !mListening){
         return;
@@ -286,15 +327,13 @@ void MainWindow::flushDataTable(){
         mRegisterWin.setValues(mSlaveAddr, regs);
     };
     if(mModbusMode == ModbusMode::MASTER){
-        if(mFuncode == 3){
-            std::vector<uint16_t> regvals = mMaster->readHoldRegister(mSlaveAddr, mSlaveRegisterCnt);
-            flushData(regvals);
-        }else{
-            std::vector<uint16_t> regvals = mMaster->readInputRegister(mSlaveAddr, mSlaveRegisterCnt);
-            flushData(regvals);
+        const AcquisitionWorker::Snapshot *snap = mAcquisition.latest();
+        if(!snap){
+            return;
         }
+        flushData(snap->values);
 
-        if(!mMaster->connected()){
+        if(!snap->connected){
             // master disconnect
             if(mConncetMode == ConnectMode::RTU){
                 ui->btnOpenCom->click();
@@ -303,14 +342,10 @@ void MainWindow::flushDataTable(){
             }
         }
     }else{
-        if(mFuncode == 3){
-            const uint16_t *registers = mSlave->getHoldRegisters();
-            std::vector<uint16_t> regs(registers, registers + mSlaveRegisterCnt);
-            flushData(regs);
-        }else{
-            const uint16_t *registers = mSlave->getInputRegisters();
-            std::vector<uint16_t> regs(registers, registers + mSlaveRegisterCnt);
-            flushData(regs);
+        // 只有寄存器被写过时才更新表格
+        auto type = mFuncode == 3 ? ModbusSlave::AddrType::HOLD_REGISTER : ModbusSlave::AddrType::INPUT_REGISTER;
+        if(mSlave->readChangedRegister(type, mSlaveAddr, mSlaveRegisterCnt, mSlaveVersions, mSlaveValues) > 0){
+            flushData(mSlaveValues);
         }
     }
 }
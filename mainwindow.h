@@ -6,6 +6,8 @@
 #include "modbusmaster.h"
 #include "modbusslave.h"
 #include "modbusregister.h"
+#include "acquisitionworker.h"
+#include "pollplan.h"
 #include <QTimer>
 
 QT_BEGIN_NAMESPACE
@@ -60,6 +62,9 @@ private:
     std::shared_ptr<ModbusMaster> mMaster;
     std::shared_ptr<ModbusSlave> mSlave;
 
+    // 主站模式下在后台线程轮询从站, 界面定时器只取最新快照
+    AcquisitionWorker mAcquisition;
+
     ModbusRegister mRegisterWin;
 
     int mSlaveId = 0;
@@ -69,13 +74,19 @@ private:
 
     QTimer mFlushTimer;
 
+    // 从站模式增量刷新: 寄存器块的序号和上次读到的值
+    std::vector<uint32_t> mSlaveVersions;
+    std::vector<uint16_t> mSlaveValues;
+
 private:
     void setMode(ModbusMode mode);
     void setConnectMode(ConnectMode mode);
     void flushComList();
+    std::string comDevice() const;
     void setSlaveConfig();
 
     void writeRegister(int addr, int value);
+    void startAcquisition();
     void flushDataTable();
 
     void setRegisterWinBtn();
@@ -0,0 +1,401 @@
+#include "modbusasyncmaster.h"
+#include "platform.h"
+
+#include <algorithm>
+#include <cerrno>
+
+namespace
+{
+// 有请求在途时等待应答的最长时间, 到期后检查新提交的请求和超时
+constexpr int POLL_MS = 5;
+// MBAP头(7字节)之后是PDU
+constexpr int PDU_OFFSET = 7;
+}
+
+ModbusAsyncMaster::ModbusAsyncMaster() {}
+
+ModbusAsyncMaster::~ModbusAsyncMaster()
+{
+    close();
+}
+
+void ModbusAsyncMaster::setTarget(const std::string &ip, uint16_t port)
+{
+    mIp = ip;
+    mPort = port;
+}
+
+void ModbusAsyncMaster::setSlave(int slaveId)
+{
+    mSlaveId = slaveId;
+}
+
+void ModbusAsyncMaster::setQueueCapacity(size_t capacity)
+{
+    mQueueCapacity = capacity > 0 ? capacity : 1;
+}
+
+void ModbusAsyncMaster::setPipelineDepth(int depth)
+{
+    mPipelineDepth = depth > 0 ? depth : 1;
+}
+
+void ModbusAsyncMaster::setTimeout(int timeoutMs)
+{
+    mTimeoutMs = timeoutMs > 0 ? timeoutMs : DEFAULT_TIMEOUT_MS;
+}
+
+bool ModbusAsyncMaster::open()
+{
+    if (mThread)
+    {
+        return true;
+    }
+    modbus_t *ctx = modbus_new_tcp(mIp.c_str(), mPort);
+    if (!ctx)
+    {
+        return false;
+    }
+    modbus_set_slave(ctx, mSlaveId);
+    modbus_set_response_timeout(ctx, mTimeoutMs / 1000, (mTimeoutMs % 1000) * 1000);
+    if (modbus_connect(ctx) == -1)
+    {
+        modbus_free(ctx);
+        return false;
+    }
+    mHandle.reset(ctx, [](modbus_t *ctx)
+                  {modbus_close(ctx); modbus_free(ctx); });
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = false;
+        mRunning = true;
+        mConnected = true;
+    }
+    mThread = std::make_unique<std::thread>(&ModbusAsyncMaster::run, this);
+    return true;
+}
+
+void ModbusAsyncMaster::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = true;
+    }
+    mCond.notify_all();
+    if (mThread && mThread->joinable())
+    {
+        mThread->join();
+    }
+    mThread.reset();
+    mHandle.reset();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRunning = false;
+    mConnected = false;
+}
+
+bool ModbusAsyncMaster::connected() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mConnected;
+}
+
+bool ModbusAsyncMaster::submitRead(unsigned int addr, unsigned int len, Callback cb)
+{
+    return submitRead(mSlaveId, MODBUS_FC_READ_HOLDING_REGISTERS, addr, len, std::move(cb));
+}
+
+bool ModbusAsyncMaster::submitRead(int slave, int function, unsigned int addr, unsigned int len, Callback cb, int timeoutMs)
+{
+    if ((function != MODBUS_FC_READ_HOLDING_REGISTERS && function != MODBUS_FC_READ_INPUT_REGISTERS)
+        || len == 0 || len > MODBUS_MAX_READ_REGISTERS || addr + len > 0x10000)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    return enqueue({slave, function, addr, len, {}, timeoutMs, std::move(cb)});
+}
+
+bool ModbusAsyncMaster::submitWrite(int slave, unsigned int addr, const std::vector<uint16_t> &values, Callback cb, int timeoutMs)
+{
+    unsigned int len = values.size();
+    if (len == 0 || len > MODBUS_MAX_WRITE_REGISTERS || addr + len > 0x10000)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    return enqueue({slave, MODBUS_FC_WRITE_MULTIPLE_REGISTERS, addr, len, values, timeoutMs, std::move(cb)});
+}
+
+std::future<ModbusAsyncMaster::Result> ModbusAsyncMaster::read(int slave, int function, unsigned int addr, unsigned int len, int timeoutMs)
+{
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+    if (!submitRead(slave, function, addr, len, [promise](const Result &result)
+                    { promise->set_value(result); }, timeoutMs))
+    {
+        promise->set_value({errno, {}});
+    }
+    return future;
+}
+
+std::future<ModbusAsyncMaster::Result> ModbusAsyncMaster::write(int slave, unsigned int addr, const std::vector<uint16_t> &values, int timeoutMs)
+{
+    auto promise = std::make_shared<std::promise<Result>>();
+    std::future<Result> future = promise->get_future();
+    if (!submitWrite(slave, addr, values, [promise](const Result &result)
+                     { promise->set_value(result); }, timeoutMs))
+    {
+        promise->set_value({errno, {}});
+    }
+    return future;
+}
+
+bool ModbusAsyncMaster::enqueue(Request &&request)
+{
+    if (request.slave < 0)
+    {
+        request.slave = mSlaveId;
+    }
+    if (request.timeoutMs < 0)
+    {
+        request.timeoutMs = mTimeoutMs;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (!mRunning || mFinish || mQueue.size() >= mQueueCapacity)
+        {
+            errno = EAGAIN;
+            return false;
+        }
+        mQueue.emplace_back(std::move(request));
+    }
+    mCond.notify_one();
+    return true;
+}
+
+void ModbusAsyncMaster::run()
+{
+    modbus_t *ctx = mHandle.get();
+    std::vector<InFlight> inflight;
+    std::vector<Request> batch;
+
+    while (true)
+    {
+        // 补满发送窗口; 没有在途请求时阻塞等待新请求
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (inflight.empty())
+            {
+                mCond.wait(lock, [this]
+                           { return mFinish || !mQueue.empty(); });
+            }
+            if (mFinish)
+            {
+                break;
+            }
+            while (!mQueue.empty() && inflight.size() + batch.size() < static_cast<size_t>(mPipelineDepth))
+            {
+                batch.emplace_back(std::move(mQueue.front()));
+                mQueue.pop_front();
+            }
+        }
+
+        if (!batch.empty())
+        {
+            if (!connected() && !reconnect())
+            {
+                int error = errno;
+                for (Request &request : batch)
+                {
+                    if (request.cb)
+                    {
+                        request.cb({error, {}});
+                    }
+                }
+                continue;
+            }
+
+            // 同一批请求合并为一次发送
+            bool ok = modbus_tcp_set_cork(ctx, 1) == 0;
+            for (Request &request : batch)
+            {
+                int tid = 0;
+                ok = ok && send(ctx, request, tid);
+                Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(request.timeoutMs);
+                inflight.push_back({tid, deadline, std::move(request)});
+            }
+            if (modbus_tcp_set_cork(ctx, 0) == -1 || !ok)
+            {
+                int error = errno;
+                modbus_close(ctx);
+                setConnected(false);
+                fail(inflight, error);
+                continue;
+            }
+        }
+
+        // 等待应答, 最长等到最早的截止时间
+        Clock::time_point now = Clock::now();
+        Clock::time_point earliest = now + std::chrono::milliseconds(POLL_MS);
+        for (const InFlight &item : inflight)
+        {
+            earliest = std::min(earliest, item.deadline);
+        }
+        int waitMs = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(earliest - now).count());
+        int rc = platform::waitReadable(modbus_get_socket(ctx), waitMs);
+        if (rc > 0)
+        {
+            receive(ctx, inflight);
+        }
+        else if (rc < 0)
+        {
+            int error = errno;
+            modbus_close(ctx);
+            setConnected(false);
+            fail(inflight, error);
+            continue;
+        }
+
+        // 超时的请求直接结束, 其迟到的应答因事务号不匹配而被丢弃
+        now = Clock::now();
+        std::vector<InFlight> expired;
+        auto it = std::stable_partition(inflight.begin(), inflight.end(), [now](const InFlight &item)
+                                        { return item.deadline > now; });
+        std::move(it, inflight.end(), std::back_inserter(expired));
+        inflight.erase(it, inflight.end());
+        fail(expired, ETIMEDOUT);
+    }
+
+    fail(inflight, ECANCELED);
+    std::deque<Request> queued;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        queued.swap(mQueue);
+    }
+    for (Request &request : queued)
+    {
+        if (request.cb)
+        {
+            request.cb({ECANCELED, {}});
+        }
+    }
+}
+
+bool ModbusAsyncMaster::reconnect()
+{
+    modbus_t *ctx = mHandle.get();
+    modbus_close(ctx);
+    if (modbus_connect(ctx) == -1)
+    {
+        return false;
+    }
+    setConnected(true);
+    return true;
+}
+
+bool ModbusAsyncMaster::send(modbus_t *ctx, const Request &request, int &tid)
+{
+    uint8_t raw[MODBUS_MAX_PDU_LENGTH + 1];
+    int len = 0;
+    raw[len++] = request.slave;
+    raw[len++] = request.function;
+    raw[len++] = request.addr >> 8;
+    raw[len++] = request.addr & 0xFF;
+    raw[len++] = request.len >> 8;
+    raw[len++] = request.len & 0xFF;
+    if (request.function == MODBUS_FC_WRITE_MULTIPLE_REGISTERS)
+    {
+        raw[len++] = request.len * 2;
+        modbus_encode_registers(raw + len, request.values.data(), static_cast<int>(request.values.size()));
+        len += 2 * static_cast<int>(request.values.size());
+    }
+    tid = modbus_send_raw_request_tid(ctx, raw, len);
+    return tid != -1;
+}
+
+void ModbusAsyncMaster::receive(modbus_t *ctx, std::vector<InFlight> &inflight)
+{
+    uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+    int rc = modbus_receive_confirmation(ctx, rsp);
+    if (rc == -1)
+    {
+        int error = errno;
+        modbus_close(ctx);
+        setConnected(false);
+        fail(inflight, error);
+        return;
+    }
+
+    int tid = (rsp[0] << 8) | rsp[1];
+    auto it = std::find_if(inflight.begin(), inflight.end(), [tid](const InFlight &item)
+                           { return item.tid == tid; });
+    if (it == inflight.end())
+    {
+        return;
+    }
+    Request request = std::move(it->request);
+    inflight.erase(it);
+    if (request.cb)
+    {
+        request.cb(decode(request, rsp, rc));
+    }
+}
+
+void ModbusAsyncMaster::fail(std::vector<InFlight> &inflight, int error)
+{
+    for (InFlight &item : inflight)
+    {
+        if (item.request.cb)
+        {
+            item.request.cb({error, {}});
+        }
+    }
+    inflight.clear();
+}
+
+ModbusAsyncMaster::Result ModbusAsyncMaster::decode(const Request &request, const uint8_t *rsp, int len)
+{
+    Result result;
+    const uint8_t *pdu = rsp + PDU_OFFSET;
+    int pduLen = len - PDU_OFFSET;
+
+    if (pduLen >= 2 && pdu[0] == (request.function | 0x80))
+    {
+        result.error = MODBUS_ENOBASE + pdu[1];
+        return result;
+    }
+    if (rsp[PDU_OFFSET - 1] != request.slave || pduLen < 1 || pdu[0] != request.function)
+    {
+        result.error = EMBBADDATA;
+        return result;
+    }
+
+    if (request.function == MODBUS_FC_WRITE_MULTIPLE_REGISTERS)
+    {
+        // 应答回显起始地址和数量
+        if (pduLen != 5 || ((pdu[1] << 8) | pdu[2]) != static_cast<int>(request.addr)
+            || ((pdu[3] << 8) | pdu[4]) != static_cast<int>(request.len))
+        {
+            result.error = EMBBADDATA;
+        }
+        return result;
+    }
+
+    if (pduLen != 2 + 2 * static_cast<int>(request.len) || pdu[1] != 2 * request.len)
+    {
+        result.error = EMBBADDATA;
+        return result;
+    }
+    result.values.resize(request.len);
+    modbus_decode_registers(result.values.data(), pdu + 2, request.len);
+    return result;
+}
+
+void ModbusAsyncMaster::setConnected(bool connected)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mConnected = connected;
+}
@@ -0,0 +1,108 @@
+#ifndef MODBUSASYNCMASTER_H
+#define MODBUSASYNCMASTER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "modbus.h"
+
+// 异步Modbus TCP主站: 每个连接一个I/O线程, 请求进入有界队列后立即返回,
+// I/O线程按事务号流水线发送并匹配应答, 调用方不会被网络往返阻塞.
+// 回调在I/O线程中执行, 不要在回调里做耗时操作.
+class ModbusAsyncMaster
+{
+public:
+    struct Result
+    {
+        // 0表示成功, 否则为errno(Modbus异常为MODBUS_ENOBASE + 异常码)
+        int error = 0;
+        std::vector<uint16_t> values;
+
+        bool ok() const { return error == 0; }
+    };
+    using Callback = std::function<void(const Result &result)>;
+
+    static constexpr int DEFAULT_TIMEOUT_MS = 500;
+
+    ModbusAsyncMaster();
+    ~ModbusAsyncMaster();
+
+    void setTarget(const std::string &ip, uint16_t port);
+    void setSlave(int slaveId);
+    // 需在open之前设置
+    void setQueueCapacity(size_t capacity);
+    void setPipelineDepth(int depth);
+    void setTimeout(int timeoutMs);
+
+    bool open();
+    // 停止I/O线程, 未完成的请求以ECANCELED结束
+    void close();
+    bool connected() const;
+
+    // 队列已满或未打开时返回false, 此时不会调用回调; timeoutMs < 0 使用默认超时
+    bool submitRead(unsigned int addr, unsigned int len, Callback cb);
+    bool submitRead(int slave, int function, unsigned int addr, unsigned int len, Callback cb, int timeoutMs = -1);
+    bool submitWrite(int slave, unsigned int addr, const std::vector<uint16_t> &values, Callback cb, int timeoutMs = -1);
+
+    // 无法入队时返回的future立即就绪, error为EAGAIN
+    std::future<Result> read(int slave, int function, unsigned int addr, unsigned int len, int timeoutMs = -1);
+    std::future<Result> write(int slave, unsigned int addr, const std::vector<uint16_t> &values, int timeoutMs = -1);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request
+    {
+        int slave;
+        int function;
+        unsigned int addr;
+        unsigned int len;
+        std::vector<uint16_t> values;
+        int timeoutMs;
+        Callback cb;
+    };
+
+    struct InFlight
+    {
+        int tid;
+        Clock::time_point deadline;
+        Request request;
+    };
+
+    std::string mIp;
+    uint16_t mPort = 502;
+    int mSlaveId = 1;
+    size_t mQueueCapacity = 1024;
+    int mPipelineDepth = 32;
+    int mTimeoutMs = DEFAULT_TIMEOUT_MS;
+
+    std::shared_ptr<modbus_t> mHandle;
+    std::unique_ptr<std::thread> mThread;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<Request> mQueue;
+    bool mRunning = false;
+    bool mFinish = false;
+    bool mConnected = false;
+
+private:
+    bool enqueue(Request &&request);
+    void run();
+    bool reconnect();
+    bool send(modbus_t *ctx, const Request &request, int &tid);
+    void receive(modbus_t *ctx, std::vector<InFlight> &inflight);
+    void fail(std::vector<InFlight> &inflight, int error);
+    static Result decode(const Request &request, const uint8_t *rsp, int len);
+    void setConnected(bool connected);
+};
+
+#endif // MODBUSASYNCMASTER_H
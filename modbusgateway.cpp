@@ -0,0 +1,413 @@
+#include "modbusgateway.h"
+#include "platform.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+constexpr int ACCEPT_POLL_MS = 50;
+// 网关面对的主站较多, 大量连接同时到达时不要被内核丢弃
+constexpr int LISTEN_LIST_LEN = 256;
+// 一个连接上一次最多取出的流水线请求数
+constexpr int PIPELINE_LIMIT = 16;
+// 广播没有应答, 发出后留给从站处理的时间
+constexpr int TURNAROUND_MS = 100;
+// TCP请求中单元号的位置(MBAP头的最后一个字节)
+constexpr int UNIT_OFFSET = 6;
+constexpr uint8_t MAX_RTU_ADDRESS = 247;
+
+bool isRead(uint8_t function)
+{
+    return function >= MODBUS_FC_READ_COILS && function <= MODBUS_FC_READ_INPUT_REGISTERS;
+}
+
+uint64_t micros(std::chrono::steady_clock::duration d)
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+}
+}
+
+ModbusGateway::~ModbusGateway()
+{
+    close();
+}
+
+void ModbusGateway::setLocalPort(const std::string &ip, int port)
+{
+    mIp = ip;
+    mPort = port;
+}
+
+void ModbusGateway::setTarget(const std::string &com, int baud, char parity, int databits, int stopbits)
+{
+    mCom = com;
+    mBaud = baud;
+    mParity = parity;
+    mDataBits = databits;
+    mStopBits = stopbits;
+}
+
+void ModbusGateway::setResponseTimeout(int ms)
+{
+    mResponseTimeoutMs = std::max(1, ms);
+}
+
+void ModbusGateway::setQueueLimit(int limit)
+{
+    mQueueLimit = static_cast<size_t>(std::max(1, limit));
+}
+
+bool ModbusGateway::open()
+{
+    if (mBus)
+    {
+        return true;
+    }
+
+    modbus_t *bus = modbus_new_rtu(mCom.c_str(), mBaud, mParity, mDataBits, mStopBits);
+    if (!bus)
+    {
+        return false;
+    }
+    if (modbus_connect(bus) == -1)
+    {
+        modbus_free(bus);
+        return false;
+    }
+    modbus_set_response_timeout(bus, mResponseTimeoutMs / 1000, (mResponseTimeoutMs % 1000) * 1000);
+
+    modbus_t *listen = modbus_new_tcp(mIp.c_str(), mPort);
+    if (listen)
+    {
+        mSockServ = modbus_tcp_listen(listen, LISTEN_LIST_LEN);
+    }
+    if (!listen || mSockServ == -1)
+    {
+        if (listen)
+        {
+            modbus_free(listen);
+        }
+        modbus_close(bus);
+        modbus_free(bus);
+        mSockServ = platform::INVALID_SOCK;
+        return false;
+    }
+
+    mBus = bus;
+    mListen = listen;
+    mFinish = false;
+    mBusError = false;
+    mStats = Stats{};
+    mBusThread = std::make_unique<std::thread>(&ModbusGateway::busLoop, this);
+    mListenThread = std::make_unique<std::thread>(&ModbusGateway::listenLoop, this);
+    return true;
+}
+
+void ModbusGateway::close()
+{
+    if (!mBus)
+    {
+        return;
+    }
+    {
+        // 唤醒所有等待排队中事务的连接, 正在总线上的事务完成后由总线线程唤醒
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = true;
+        for (auto &transaction : mQueue)
+        {
+            transaction->cond.notify_all();
+        }
+    }
+    mQueueCond.notify_all();
+    mListenThread->join();
+    mListenThread.reset();
+    mBusThread->join();
+    mBusThread.reset();
+    mQueue.clear();
+
+    platform::closeSocket(mSockServ);
+    mSockServ = platform::INVALID_SOCK;
+    modbus_free(mListen);
+    mListen = nullptr;
+    modbus_close(mBus);
+    modbus_free(mBus);
+    mBus = nullptr;
+}
+
+ModbusGateway::Stats ModbusGateway::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+void ModbusGateway::listenLoop()
+{
+    if (!platform::setNonBlocking(mSockServ))
+    {
+        return;
+    }
+
+    std::list<Client> clients;
+    while (!mFinish)
+    {
+        // 回收已断开连接的线程
+        for (auto it = clients.begin(); it != clients.end();)
+        {
+            if (it->finished)
+            {
+                it->thread.join();
+                it = clients.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        // 有连接到达时立即返回, 超时只用于检查mFinish
+        if (platform::waitReadable(mSockServ, ACCEPT_POLL_MS) <= 0)
+        {
+            continue;
+        }
+        // 一次取完所有已到达的连接
+        int sock;
+        while (!mFinish && (sock = modbus_tcp_accept(mListen, &mSockServ)) != -1)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mClientSocks.insert(sock);
+            }
+            clients.emplace_back();
+            Client &client = clients.back();
+            client.thread = std::thread(&ModbusGateway::handleClient, this, sock, &client);
+        }
+    }
+
+    // 断开所有连接, 阻塞在接收上的线程随即返回
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (int sock : mClientSocks)
+        {
+            platform::shutdownSocket(sock);
+        }
+    }
+    for (Client &client : clients)
+    {
+        client.thread.join();
+    }
+}
+
+void ModbusGateway::handleClient(int sock, Client *client)
+{
+    modbus_t *ctx = modbus_new_tcp(nullptr, 0);
+    if (ctx)
+    {
+        modbus_set_socket(ctx, sock);
+        platform::setNoDelay(sock);
+    }
+
+    std::vector<Pending> pending;
+    pending.reserve(PIPELINE_LIMIT);
+    bool ok = ctx != nullptr;
+    while (ok && !mFinish)
+    {
+        // 主站流水线发来的请求一起入队, 同一连接的应答按请求顺序返回
+        pending.clear();
+        do
+        {
+            pending.emplace_back();
+            Pending &p = pending.back();
+            int rc = modbus_receive(ctx, p.query);
+            if (rc == -1 && errno == EMBBADDATA)
+            {
+                // 畸形请求已被丢弃, 连接仍然同步
+                pending.pop_back();
+                continue;
+            }
+            if (rc == -1)
+            {
+                ok = false;
+                pending.pop_back();
+                break;
+            }
+            // 至少包含单元号和功能码
+            if (rc < UNIT_OFFSET + 2)
+            {
+                pending.pop_back();
+                continue;
+            }
+            p.queryLength = rc;
+            p.queued = Clock::now();
+            p.transaction = submit(p.query + UNIT_OFFSET, rc - UNIT_OFFSET);
+        } while (static_cast<int>(pending.size()) < PIPELINE_LIMIT && modbus_tcp_has_indication(ctx) == 1);
+
+        for (Pending &p : pending)
+        {
+            if (!p.transaction)
+            {
+                if (modbus_reply_exception(ctx, p.query, MODBUS_EXCEPTION_GATEWAY_PATH) == -1)
+                {
+                    ok = false;
+                }
+                continue;
+            }
+
+            Transaction &transaction = *p.transaction;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                transaction.cond.wait(lock, [this, &transaction]
+                                      { return transaction.done || mFinish; });
+                if (!transaction.done)
+                {
+                    ok = false;
+                    break;
+                }
+                uint64_t wait = micros(transaction.started - p.queued);
+                mStats.queueWaitUs += wait;
+                mStats.maxQueueWaitUs = std::max(mStats.maxQueueWaitUs, wait);
+            }
+            // 事务完成后应答不再变化, 不需要持锁
+            if (ok && transaction.responseLength > 0 &&
+                modbus_reply_raw(ctx, p.query, p.queryLength, transaction.response,
+                                 transaction.responseLength) == -1)
+            {
+                ok = false;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClientSocks.erase(sock);
+        // 持锁关闭, 避免close对已被复用的描述符调用shutdown
+        if (ctx)
+        {
+            modbus_close(ctx);
+            modbus_free(ctx);
+        }
+        else
+        {
+            platform::closeSocket(sock);
+        }
+    }
+    client->finished = true;
+}
+
+std::shared_ptr<ModbusGateway::Transaction> ModbusGateway::submit(const uint8_t *request, int length)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStats.requests++;
+    // RTU地址只有0~247
+    if (mFinish || request[0] > MAX_RTU_ADDRESS)
+    {
+        return nullptr;
+    }
+    if (isRead(request[1]))
+    {
+        // 从队尾向前找, 遇到同一单元的非读请求就停止: 排在写之前的读返回的是写之前的值
+        for (auto it = mQueue.rbegin(); it != mQueue.rend(); ++it)
+        {
+            const Transaction &queued = **it;
+            if (queued.request[0] == request[0] && !isRead(queued.request[1]))
+            {
+                break;
+            }
+            if (queued.requestLength == length && memcmp(queued.request, request, length) == 0)
+            {
+                mStats.coalesced++;
+                return *it;
+            }
+        }
+    }
+    if (mQueue.size() >= mQueueLimit)
+    {
+        mStats.rejected++;
+        return nullptr;
+    }
+
+    auto transaction = std::make_shared<Transaction>();
+    memcpy(transaction->request, request, length);
+    transaction->requestLength = length;
+    mQueue.push_back(transaction);
+    mQueueCond.notify_one();
+    return transaction;
+}
+
+void ModbusGateway::busLoop()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mQueueCond.wait(lock, [this]
+                        { return mFinish || !mQueue.empty(); });
+        if (mFinish)
+        {
+            break;
+        }
+        std::shared_ptr<Transaction> transaction = mQueue.front();
+        mQueue.pop_front();
+        transaction->started = Clock::now();
+        lock.unlock();
+
+        bool ok = transact(*transaction);
+        uint64_t busTime = micros(Clock::now() - transaction->started);
+
+        lock.lock();
+        transaction->done = true;
+        mStats.transactions++;
+        mStats.busTimeUs += busTime;
+        if (!ok)
+        {
+            mStats.timeouts++;
+        }
+        transaction->cond.notify_all();
+    }
+}
+
+bool ModbusGateway::transact(Transaction &transaction)
+{
+    const uint8_t unit = transaction.request[0];
+    const uint8_t function = transaction.request[1];
+
+    modbus_set_slave(mBus, unit);
+    if (mBusError)
+    {
+        modbus_flush(mBus);
+        mBusError = false;
+    }
+    if (modbus_send_raw_request(mBus, transaction.request, transaction.requestLength) == -1)
+    {
+        mBusError = true;
+        gatewayException(transaction, MODBUS_EXCEPTION_GATEWAY_PATH);
+        return false;
+    }
+    if (unit == MODBUS_BROADCAST_ADDRESS)
+    {
+        platform::sleepMs(TURNAROUND_MS);
+        return true;
+    }
+
+    uint8_t rsp[MODBUS_RTU_MAX_ADU_LENGTH];
+    int rc = modbus_receive_confirmation(mBus, rsp);
+    // 应答去掉CRC后至少包含单元号和功能码, 且必须对应本次请求
+    if (rc < 4 || rsp[0] != unit || (rsp[1] & 0x7F) != function)
+    {
+        mBusError = true;
+        gatewayException(transaction, MODBUS_EXCEPTION_GATEWAY_TARGET);
+        return false;
+    }
+    transaction.responseLength = rc - 2;
+    memcpy(transaction.response, rsp, transaction.responseLength);
+    return true;
+}
+
+void ModbusGateway::gatewayException(Transaction &transaction, int exception)
+{
+    transaction.response[0] = transaction.request[0];
+    transaction.response[1] = transaction.request[1] | 0x80;
+    transaction.response[2] = static_cast<uint8_t>(exception);
+    transaction.responseLength = transaction.request[0] == MODBUS_BROADCAST_ADDRESS ? 0 : 3;
+}
@@ -0,0 +1,132 @@
+#ifndef MODBUSGATEWAY_H
+#define MODBUSGATEWAY_H
+
+#include "modbus.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// TCP转RTU网关: 在TCP端口上接受主站连接, 把请求按单元号转发到一条RTU总线(真实串口或虚拟总线的伪终端).
+// 总线同一时刻只能有一个事务, 所有连接的请求进入同一个队列, 由总线线程依次发送;
+// 每个请求记住自己的事务号, 应答从总线回来后换上原来的MBAP头发回对应的连接.
+// 队列中尚未发出的相同读请求(单元号和PDU完全相同的01~04功能码)合并成一次总线事务, 应答分发给每个请求者;
+// 只与同一单元最后一个写请求之后排队的读合并, 保证读到的不早于请求前已提交的写.
+// 总线无应答或应答不匹配时回复网关目标设备无响应异常(0x0B), 单元号超出RTU地址范围、队列已满或网关关闭时
+// 回复网关路径不可用异常(0x0A);
+// 单元号0为广播, 转发后不回复.
+class ModbusGateway
+{
+public:
+    // 累计统计, 时间单位为微秒
+    struct Stats
+    {
+        uint64_t requests = 0;      // 收到的TCP请求数
+        uint64_t transactions = 0;  // 实际的总线事务数
+        uint64_t coalesced = 0;     // 合并到已排队请求上的读请求数
+        uint64_t timeouts = 0;      // 总线无应答或应答出错的事务数
+        uint64_t rejected = 0;      // 队列已满被拒绝的请求数
+        uint64_t queueWaitUs = 0;   // 所有请求从入队到开始发送的等待时间之和
+        uint64_t maxQueueWaitUs = 0;
+        uint64_t busTimeUs = 0;     // 所有总线事务的耗时之和
+    };
+
+    static constexpr int DEFAULT_RESPONSE_TIMEOUT_MS = 500;
+    static constexpr int DEFAULT_QUEUE_LIMIT = 256;
+
+    ModbusGateway() = default;
+    ~ModbusGateway();
+
+    ModbusGateway(const ModbusGateway &) = delete;
+    ModbusGateway &operator=(const ModbusGateway &) = delete;
+
+    void setLocalPort(const std::string &ip, int port);
+    void setTarget(const std::string &com, int baud, char parity, int databits, int stopbits);
+    // 等待总线上设备应答的时间
+    void setResponseTimeout(int ms);
+    // 排队中(未合并)的事务数上限
+    void setQueueLimit(int limit);
+
+    bool open();
+    void close();
+    bool isOpen() const { return mBus != nullptr; }
+
+    Stats stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 一次总线事务, 合并的请求共用同一个事务
+    struct Transaction
+    {
+        // 单元号 + PDU, 不含MBAP头和CRC
+        uint8_t request[MODBUS_MAX_PDU_LENGTH + 1];
+        int requestLength = 0;
+        uint8_t response[MODBUS_MAX_PDU_LENGTH + 1];
+        // 0表示不回复(广播); 出错时为网关异常应答
+        int responseLength = 0;
+        bool done = false;
+        Clock::time_point started;
+        std::condition_variable cond;
+    };
+
+    // 一个连接上已提交、等待应答的请求
+    struct Pending
+    {
+        uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
+        int queryLength = 0;
+        std::shared_ptr<Transaction> transaction;
+        Clock::time_point queued;
+    };
+
+    struct Client
+    {
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    std::string mIp = "0.0.0.0";
+    int mPort = 502;
+    std::string mCom;
+    int mBaud = 9600;
+    char mParity = 'N';
+    int mDataBits = 8;
+    int mStopBits = 1;
+    int mResponseTimeoutMs = DEFAULT_RESPONSE_TIMEOUT_MS;
+    size_t mQueueLimit = DEFAULT_QUEUE_LIMIT;
+
+    modbus_t *mListen = nullptr;
+    modbus_t *mBus = nullptr;
+    int mSockServ = -1;
+    std::atomic<bool> mFinish{false};
+    std::unique_ptr<std::thread> mListenThread;
+    std::unique_ptr<std::thread> mBusThread;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mQueueCond;
+    std::deque<std::shared_ptr<Transaction>> mQueue;
+    std::set<int> mClientSocks;
+    Stats mStats;
+    // 上一次事务出错, 下一次发送前先丢弃总线上迟到的字节
+    bool mBusError = false;
+
+private:
+    void listenLoop();
+    void handleClient(int sock, Client *client);
+    void busLoop();
+    // 返回false表示总线出错或无应答, 此时transaction中为网关异常应答
+    bool transact(Transaction &transaction);
+    // 请求入队, 与该单元最后一个写之后排队的相同读请求合并; 无法转发时返回nullptr
+    std::shared_ptr<Transaction> submit(const uint8_t *request, int length);
+    static void gatewayException(Transaction &transaction, int exception);
+};
+
+#endif // MODBUSGATEWAY_H
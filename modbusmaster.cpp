@@ -1,6 +1,8 @@
 #include "modbusmaster.h"
 #include "Log.hpp"
 
+#include <algorithm>
+
 ModbusMaster::ModbusMaster() {}
 
 void ModbusMaster::setSlave(int slaveId)
@@ -93,6 +95,101 @@ std::vector<uint16_t> ModbusMaster::readInputRegister(unsigned int addr, unsigne
     }
 }
 
+std::vector<std::vector<uint16_t>> ModbusMaster::readRegisters(const std::vector<ReadRequest> &requests)
+{
+    std::vector<std::vector<uint16_t>> res(requests.size());
+    if (!mHandle)
+    {
+        return res;
+    }
+    modbus_t *ctx = mHandle.get();
+
+    // RTU为单请求总线, 逐个读取
+    if (modbus_tcp_set_cork(ctx, 1) == -1)
+    {
+        for (size_t i = 0; i < requests.size(); i++)
+        {
+            const ReadRequest &r = requests[i];
+            res[i] = r.function == MODBUS_FC_READ_INPUT_REGISTERS ? readInputRegister(r.addr, r.len)
+                                                                  : readHoldRegister(r.addr, r.len);
+            if (!mHandle)
+            {
+                break;
+            }
+        }
+        return res;
+    }
+
+    // 事务号 -> 请求序号
+    std::vector<std::pair<int, size_t>> inflight;
+    size_t next = 0;
+    bool ok = true;
+    while (ok && (next < requests.size() || !inflight.empty()))
+    {
+        // 补满发送窗口, 同一批请求合并为一次发送
+        modbus_tcp_set_cork(ctx, 1);
+        while (next < requests.size() && inflight.size() < static_cast<size_t>(PIPELINE_DEPTH))
+        {
+            const ReadRequest &r = requests[next];
+            if (r.len == 0 || r.len > MODBUS_MAX_READ_REGISTERS)
+            {
+                next++;
+                continue;
+            }
+            uint8_t raw[6] = {static_cast<uint8_t>(mSlaveId), static_cast<uint8_t>(r.function),
+                              static_cast<uint8_t>(r.addr >> 8), static_cast<uint8_t>(r.addr),
+                              static_cast<uint8_t>(r.len >> 8), static_cast<uint8_t>(r.len)};
+            int tid = modbus_send_raw_request_tid(ctx, raw, sizeof(raw));
+            if (tid == -1)
+            {
+                ok = false;
+                break;
+            }
+            inflight.emplace_back(tid, next++);
+        }
+        if (modbus_tcp_set_cork(ctx, 0) == -1)
+        {
+            ok = false;
+        }
+        if (!ok || inflight.empty())
+        {
+            break;
+        }
+
+        uint8_t rsp[MODBUS_TCP_MAX_ADU_LENGTH];
+        int rc = modbus_receive_confirmation(ctx, rsp);
+        if (rc == -1)
+        {
+            ok = false;
+            break;
+        }
+        int tid = (rsp[0] << 8) | rsp[1];
+        auto it = std::find_if(inflight.begin(), inflight.end(),
+                               [tid](const std::pair<int, size_t> &p) { return p.first == tid; });
+        if (it == inflight.end())
+        {
+            // 未知事务号(例如之前超时请求的迟到应答), 丢弃
+            continue;
+        }
+        const ReadRequest &r = requests[it->second];
+        // MBAP头(7) + 功能码(1) + 字节数(1) + 数据
+        if (rc == 9 + 2 * static_cast<int>(r.len) && rsp[7] == r.function && rsp[8] == 2 * r.len)
+        {
+            std::vector<uint16_t> &values = res[it->second];
+            values.resize(r.len);
+            modbus_decode_registers(values.data(), rsp + 9, r.len);
+        }
+        inflight.erase(it);
+    }
+
+    if (!ok)
+    {
+        Log("Failed to read registers.");
+        checkConnect();
+    }
+    return res;
+}
+
 void ModbusMaster::close()
 {
     mHandle.reset();
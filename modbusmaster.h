@@ -6,6 +6,7 @@
 #include <regex>
 #include <uchar.h>
 #include <array>
+#include <vector>
 
 class ModbusMaster
 {
@@ -21,6 +22,15 @@ public:
 
     void writeRegister(int addr, const std::vector<uint16_t> &valus);
 
+    // 批量读取: TCP下多个请求流水线发送, 按事务号匹配应答; 失败的请求对应结果为空
+    struct ReadRequest
+    {
+        int function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        unsigned int addr = 0;
+        unsigned int len = 0;
+    };
+    std::vector<std::vector<uint16_t>> readRegisters(const std::vector<ReadRequest> &requests);
+
     virtual bool open() = 0;
     void close();
 
@@ -28,6 +38,8 @@ public:
 
 protected:
     static constexpr int UNSET_SLAVE_ID = -1;
+    // 同时在途的最大请求数, 避免从站接收缓冲区被塞满
+    static constexpr int PIPELINE_DEPTH = 16;
     std::shared_ptr<modbus_t> mHandle = nullptr;
     int mSlaveId = UNSET_SLAVE_ID;
 private:
@@ -0,0 +1,610 @@
+#include "modbusreactor.h"
+#include "platform.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <future>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+namespace
+{
+constexpr int MAX_EVENTS = 256;
+// MBAP头: 事务号(2) + 协议号(2) + 长度(2), 长度之后才是单元号和PDU
+constexpr int MBAP_PREFIX_LENGTH = 6;
+constexpr int MBAP_HEADER_LENGTH = 7;
+constexpr int RX_BUFFER_LENGTH = MODBUS_TCP_MAX_ADU_LENGTH * 4;
+// 监听被暂停时多久重试一次accept, 描述符可能被本reactor之外的代码释放
+constexpr int ACCEPT_RETRY_MS = 100;
+
+using Clock = std::chrono::steady_clock;
+
+void wakeLoop(int wakefd)
+{
+    uint64_t one = 1;
+    if (write(wakefd, &one, sizeof(one)) < 0)
+    {
+        // eventfd计数器溢出时写入失败, 此时线程已经处于被唤醒状态
+    }
+}
+}
+
+struct ModbusTcpReactor::Connection
+{
+    modbus_t *ctx = nullptr;
+    std::shared_ptr<Listener> listener;
+    uint8_t buf[RX_BUFFER_LENGTH];
+    int begin = 0;
+    int end = 0;
+    // 应答有未发出的尾部, 此时只关注可写, 不再读取该连接的请求
+    bool writing = false;
+};
+
+struct ModbusTcpReactor::Loop
+{
+    int epfd = -1;
+    int wakefd = -1;
+    std::unique_ptr<std::thread> thread;
+    std::unordered_map<int, std::unique_ptr<Connection>> clients;
+    // 本事件循环中暂停accept的监听套接字, 最迟在resumeAt重试; hasPaused供其他事件循环判断是否需要唤醒
+    std::vector<int> paused;
+    Clock::time_point resumeAt;
+    std::atomic<bool> hasPaused{false};
+
+    // 其他线程投递到本事件循环执行的任务
+    std::mutex taskMutex;
+    std::vector<std::function<void()>> tasks;
+};
+
+ModbusTcpReactor::ModbusTcpReactor(int threads)
+    : mThreadCnt(threads > 0 ? threads : 1)
+{
+}
+
+ModbusTcpReactor::~ModbusTcpReactor()
+{
+    stop();
+}
+
+bool ModbusTcpReactor::supported()
+{
+    return true;
+}
+
+void ModbusTcpReactor::setMaxConnections(int maxConnections)
+{
+    mMaxConnections = maxConnections > 0 ? maxConnections : 0;
+}
+
+bool ModbusTcpReactor::start()
+{
+    if (!mLoops.empty())
+    {
+        return false;
+    }
+    mFinish = false;
+
+    for (int i = 0; i < mThreadCnt; i++)
+    {
+        auto loop = std::make_unique<Loop>();
+        loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epfd == -1 || loop->wakefd == -1)
+        {
+            if (loop->epfd != -1)
+            {
+                ::close(loop->epfd);
+            }
+            if (loop->wakefd != -1)
+            {
+                ::close(loop->wakefd);
+            }
+            stop();
+            return false;
+        }
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = loop->wakefd;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wakefd, &ev);
+
+        mLoops.emplace_back(std::move(loop));
+    }
+
+    for (auto &loop : mLoops)
+    {
+        loop->thread = std::make_unique<std::thread>(&ModbusTcpReactor::run, this, loop.get());
+    }
+    return true;
+}
+
+bool ModbusTcpReactor::start(int sockServ, FrameHandler handler)
+{
+    if (!start())
+    {
+        return false;
+    }
+    if (!addListener(sockServ, std::move(handler)))
+    {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void ModbusTcpReactor::stop()
+{
+    mFinish = true;
+    for (auto &loop : mLoops)
+    {
+        wakeLoop(loop->wakefd);
+    }
+    for (auto &loop : mLoops)
+    {
+        if (loop->thread && loop->thread->joinable())
+        {
+            loop->thread->join();
+        }
+        // 线程退出前没来得及执行的任务(如移除监听)在这里完成
+        runTasks(loop.get());
+        while (!loop->clients.empty())
+        {
+            closeClient(loop.get(), loop->clients.begin()->first);
+        }
+        ::close(loop->wakefd);
+        ::close(loop->epfd);
+    }
+    mLoops.clear();
+
+    std::lock_guard<std::mutex> lock(mListenerMutex);
+    mListeners.clear();
+}
+
+bool ModbusTcpReactor::addListener(int sockServ, FrameHandler handler)
+{
+    if (mLoops.empty() || !platform::setNonBlocking(sockServ))
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mListenerMutex);
+        mListeners[sockServ] = std::make_shared<Listener>(Listener{sockServ, std::move(handler)});
+    }
+
+    // 多个事件循环共享监听套接字, EPOLLEXCLUSIVE避免一次连接唤醒所有线程
+    for (auto &loop : mLoops)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = sockServ;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sockServ, &ev) == -1)
+        {
+            removeListener(sockServ);
+            return false;
+        }
+    }
+    return true;
+}
+
+void ModbusTcpReactor::removeListener(int sockServ)
+{
+    {
+        std::lock_guard<std::mutex> lock(mListenerMutex);
+        if (mListeners.erase(sockServ) == 0)
+        {
+            return;
+        }
+    }
+
+    // 由各事件循环自己关闭属于该监听的连接, 任务执行完说明不会再调用它的处理函数
+    std::vector<std::future<void>> done;
+    for (auto &loop : mLoops)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        done.emplace_back(promise->get_future());
+        Loop *l = loop.get();
+        {
+            std::lock_guard<std::mutex> lock(l->taskMutex);
+            l->tasks.emplace_back([this, l, sockServ, promise]
+                                  {
+                                      epoll_ctl(l->epfd, EPOLL_CTL_DEL, sockServ, nullptr);
+                                      l->paused.erase(std::remove(l->paused.begin(), l->paused.end(), sockServ),
+                                                      l->paused.end());
+                                      l->hasPaused = !l->paused.empty();
+                                      std::vector<int> socks;
+                                      for (auto &client : l->clients)
+                                      {
+                                          if (client.second->listener->sock == sockServ)
+                                          {
+                                              socks.push_back(client.first);
+                                          }
+                                      }
+                                      for (int sock : socks)
+                                      {
+                                          closeClient(l, sock);
+                                      }
+                                      promise->set_value(); });
+        }
+        wakeLoop(l->wakefd);
+    }
+    for (auto &f : done)
+    {
+        f.wait();
+    }
+}
+
+void ModbusTcpReactor::run(Loop *loop)
+{
+    epoll_event events[MAX_EVENTS];
+    while (!mFinish)
+    {
+        // 忙碌的事件循环可能一直等不到超时, 每一轮都检查重试时间
+        int timeout = -1;
+        if (!loop->paused.empty())
+        {
+            if (Clock::now() >= loop->resumeAt)
+            {
+                resumeListeners(loop);
+            }
+            if (!loop->paused.empty())
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(loop->resumeAt - Clock::now());
+                timeout = static_cast<int>(std::max<int64_t>(0, left.count()));
+            }
+        }
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout);
+        if (n == 0)
+        {
+            continue;
+        }
+        if (n == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == loop->wakefd)
+            {
+                uint64_t cnt;
+                if (read(loop->wakefd, &cnt, sizeof(cnt)) < 0)
+                {
+                    // 计数已被读走
+                }
+                runTasks(loop);
+                // 可能是其他事件循环关闭了连接
+                resumeListeners(loop);
+                continue;
+            }
+            if (loop->clients.count(fd))
+            {
+                bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP));
+                if (ok)
+                {
+                    ok = (events[i].events & EPOLLOUT) ? writeClient(loop, fd) : readClient(loop, fd);
+                }
+                if (!ok)
+                {
+                    closeClient(loop, fd);
+                    resumeListeners(loop);
+                }
+                continue;
+            }
+
+            std::shared_ptr<Listener> listener;
+            {
+                std::lock_guard<std::mutex> lock(mListenerMutex);
+                auto it = mListeners.find(fd);
+                if (it != mListeners.end())
+                {
+                    listener = it->second;
+                }
+            }
+            if (listener)
+            {
+                acceptClients(loop, listener);
+            }
+        }
+    }
+}
+
+void ModbusTcpReactor::runTasks(Loop *loop)
+{
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(loop->taskMutex);
+        tasks.swap(loop->tasks);
+    }
+    for (auto &task : tasks)
+    {
+        task();
+    }
+}
+
+void ModbusTcpReactor::acceptClients(Loop *loop, const std::shared_ptr<Listener> &listener)
+{
+    while (true)
+    {
+        if (mMaxConnections > 0 && mConnections >= mMaxConnections)
+        {
+            pauseListener(loop, listener->sock);
+            return;
+        }
+        int sock = accept4(listener->sock, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (sock == -1)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // EAGAIN: 已取完所有等待的连接; 被其他线程抢先接受同样返回EAGAIN.
+            // 其他错误(EMFILE/ENFILE/ENOBUFS/ENOMEM)时连接仍在监听队列中, 暂停一段时间再试
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                pauseListener(loop, listener->sock);
+            }
+            return;
+        }
+
+        platform::setNoDelay(sock);
+
+        modbus_t *ctx = modbus_new_tcp(nullptr, 0);
+        if (!ctx)
+        {
+            ::close(sock);
+            continue;
+        }
+        modbus_set_socket(ctx, sock);
+        // 对端读得慢时应答留在发送缓冲中, 不阻塞事件循环
+        modbus_tcp_set_send_nonblocking(ctx, 1);
+
+        auto client = std::make_unique<Connection>();
+        client->ctx = ctx;
+        client->listener = listener;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = sock;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sock, &ev) == -1)
+        {
+            modbus_free(ctx);
+            ::close(sock);
+            continue;
+        }
+        loop->clients.emplace(sock, std::move(client));
+        mConnections++;
+    }
+}
+
+void ModbusTcpReactor::pauseListener(Loop *loop, int sockServ)
+{
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, sockServ, nullptr);
+    loop->paused.push_back(sockServ);
+    loop->resumeAt = Clock::now() + std::chrono::milliseconds(ACCEPT_RETRY_MS);
+    loop->hasPaused = true;
+}
+
+void ModbusTcpReactor::resumeListeners(Loop *loop)
+{
+    if (loop->paused.empty())
+    {
+        return;
+    }
+    if (mMaxConnections > 0 && mConnections >= mMaxConnections)
+    {
+        loop->resumeAt = Clock::now() + std::chrono::milliseconds(ACCEPT_RETRY_MS);
+        return;
+    }
+    // 期间被移除的监听不再恢复
+    std::lock_guard<std::mutex> lock(mListenerMutex);
+    for (int sockServ : loop->paused)
+    {
+        if (mListeners.count(sockServ))
+        {
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+            ev.data.fd = sockServ;
+            epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sockServ, &ev);
+        }
+    }
+    loop->paused.clear();
+    loop->hasPaused = false;
+}
+
+bool ModbusTcpReactor::readClient(Loop *loop, int sock)
+{
+    auto it = loop->clients.find(sock);
+    if (it == loop->clients.end())
+    {
+        return false;
+    }
+    Connection &conn = *it->second;
+
+    // 把残留的半帧移到缓冲区头部, 腾出尽可能多的空间一次读完
+    if (conn.begin > 0)
+    {
+        memmove(conn.buf, conn.buf + conn.begin, conn.end - conn.begin);
+        conn.end -= conn.begin;
+        conn.begin = 0;
+    }
+
+    ssize_t rc = recv(sock, conn.buf + conn.end, RX_BUFFER_LENGTH - conn.end, 0);
+    if (rc == 0)
+    {
+        return false;
+    }
+    if (rc < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    conn.end += rc;
+    return processFrames(loop, sock, conn);
+}
+
+bool ModbusTcpReactor::writeClient(Loop *loop, int sock)
+{
+    auto it = loop->clients.find(sock);
+    if (it == loop->clients.end())
+    {
+        return false;
+    }
+    Connection &conn = *it->second;
+
+    int pending = modbus_tcp_flush_send(conn.ctx);
+    if (pending != 0)
+    {
+        return pending > 0;
+    }
+    // 尾部发完后继续处理之前因发送缓冲已满而留下的请求
+    return processFrames(loop, sock, conn);
+}
+
+bool ModbusTcpReactor::processFrames(Loop *loop, int sock, Connection &conn)
+{
+    // 按MBAP长度字段逐帧切分, 一次读取可能包含多个请求;
+    // 流水线上的多个应答先攒在一起, 处理完本次读到的所有请求后一次发出
+    bool ok = true;
+    modbus_tcp_set_cork(conn.ctx, 1);
+    while (conn.end - conn.begin >= MBAP_HEADER_LENGTH)
+    {
+        const uint8_t *frame = conn.buf + conn.begin;
+        int protocol = (frame[2] << 8) | frame[3];
+        int length = MBAP_PREFIX_LENGTH + ((frame[4] << 8) | frame[5]);
+        if (protocol != 0 || length < MBAP_HEADER_LENGTH + 1 || length > MODBUS_TCP_MAX_ADU_LENGTH)
+        {
+            ok = false;
+            break;
+        }
+        if (conn.end - conn.begin < length)
+        {
+            break;
+        }
+        // 发送缓冲放不下一个最长的应答时先发出已有的; 对端仍不读取则停止处理, 等可写后再继续
+        if (modbus_tcp_get_send_pending(conn.ctx) + MODBUS_TCP_MAX_ADU_LENGTH > MODBUS_TCP_SEND_BUFFER_LENGTH)
+        {
+            int pending = modbus_tcp_flush_send(conn.ctx);
+            if (pending == -1)
+            {
+                ok = false;
+                break;
+            }
+            if (pending + MODBUS_TCP_MAX_ADU_LENGTH > MODBUS_TCP_SEND_BUFFER_LENGTH)
+            {
+                break;
+            }
+        }
+        // MBAP长度只给出帧的边界, 功能码要求的字段不全(如FC16的字节数超出帧尾)时不交给处理函数
+        int expected = modbus_get_indication_length(conn.ctx, frame, length);
+        if (expected <= 0 || length < expected)
+        {
+            if (modbus_reply_exception(conn.ctx, frame, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE) == -1)
+            {
+                ok = false;
+                break;
+            }
+            conn.begin += length;
+            continue;
+        }
+        if (conn.listener->handler(conn.ctx, frame, length) == -1)
+        {
+            ok = false;
+            break;
+        }
+        conn.begin += length;
+    }
+    if (modbus_tcp_set_cork(conn.ctx, 0) == -1 || !ok)
+    {
+        return false;
+    }
+
+    // 有未发出的尾部时改为等待可写, 发完后恢复读取
+    bool writing = modbus_tcp_get_send_pending(conn.ctx) > 0;
+    if (writing != conn.writing)
+    {
+        epoll_event ev{};
+        ev.events = writing ? EPOLLOUT : (EPOLLIN | EPOLLRDHUP);
+        ev.data.fd = sock;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_MOD, sock, &ev) == -1)
+        {
+            return false;
+        }
+        conn.writing = writing;
+    }
+    return true;
+}
+
+void ModbusTcpReactor::closeClient(Loop *loop, int sock)
+{
+    auto it = loop->clients.find(sock);
+    if (it == loop->clients.end())
+    {
+        return;
+    }
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, sock, nullptr);
+    modbus_close(it->second->ctx);
+    modbus_free(it->second->ctx);
+    loop->clients.erase(it);
+    mConnections--;
+
+    // 暂停了accept的事件循环不一定是本循环, 唤醒它们立即重试; 停止时其他循环的eventfd可能已关闭
+    for (auto &other : mLoops)
+    {
+        if (!mFinish && other.get() != loop && other->hasPaused)
+        {
+            wakeLoop(other->wakefd);
+        }
+    }
+}
+
+#else
+
+struct ModbusTcpReactor::Loop
+{
+};
+
+ModbusTcpReactor::ModbusTcpReactor(int threads)
+    : mThreadCnt(threads > 0 ? threads : 1)
+{
+}
+
+ModbusTcpReactor::~ModbusTcpReactor() {}
+
+bool ModbusTcpReactor::supported()
+{
+    return false;
+}
+
+void ModbusTcpReactor::setMaxConnections(int) {}
+
+bool ModbusTcpReactor::start()
+{
+    return false;
+}
+
+bool ModbusTcpReactor::start(int, FrameHandler)
+{
+    return false;
+}
+
+void ModbusTcpReactor::stop() {}
+
+bool ModbusTcpReactor::addListener(int, FrameHandler)
+{
+    return false;
+}
+
+void ModbusTcpReactor::removeListener(int) {}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef MODBUSREACTOR_H
+#define MODBUSREACTOR_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "modbus.h"
+
+// 基于epoll的Modbus TCP服务端, 少量事件循环线程复用监听套接字和所有客户端连接,
+// 不再为每个主站创建线程. 仅Linux可用, 其他平台supported()返回false.
+// 一个reactor可以同时服务多个监听套接字(每个对应一个从站), 大量从站共用几个线程.
+class ModbusTcpReactor
+{
+public:
+    // 收到一帧完整的MBAP请求后调用, 返回-1时关闭该连接
+    using FrameHandler = std::function<int(modbus_t *ctx, const uint8_t *req, int len)>;
+
+    explicit ModbusTcpReactor(int threads = 1);
+    ~ModbusTcpReactor();
+
+    static bool supported();
+
+    // 所有监听套接字合计的连接数上限, 0表示不限; 达到上限后暂停accept, 新连接留在内核的监听队列中,
+    // 有连接关闭后恢复. 需在start之前调用
+    void setMaxConnections(int maxConnections);
+
+    // 只启动事件循环, 监听套接字之后用addListener添加
+    bool start();
+    bool start(int sockServ, FrameHandler handler);
+    void stop();
+
+    bool addListener(int sockServ, FrameHandler handler);
+    // 返回时该监听套接字上的连接都已关闭, 且不会再有处理函数在执行; 不能在处理函数中调用
+    void removeListener(int sockServ);
+
+    struct Listener
+    {
+        int sock;
+        FrameHandler handler;
+    };
+
+private:
+    struct Loop;
+    struct Connection;
+
+    int mThreadCnt;
+    int mMaxConnections = 0;
+    std::atomic<int> mConnections{0};
+    std::atomic<bool> mFinish{false};
+    std::vector<std::unique_ptr<Loop>> mLoops;
+
+    std::mutex mListenerMutex;
+    std::unordered_map<int, std::shared_ptr<Listener>> mListeners;
+
+private:
+    void run(Loop *loop);
+    void runTasks(Loop *loop);
+    void acceptClients(Loop *loop, const std::shared_ptr<Listener> &listener);
+    // 暂停/恢复本事件循环对监听套接字的关注, 连接数已满或描述符耗尽时避免水平触发的监听事件让线程空转
+    void pauseListener(Loop *loop, int sockServ);
+    void resumeListeners(Loop *loop);
+    bool readClient(Loop *loop, int sock);
+    bool writeClient(Loop *loop, int sock);
+    // 处理缓冲中的完整请求, 发送缓冲将满时暂停读取、改为等待可写
+    bool processFrames(Loop *loop, int sock, Connection &conn);
+    void closeClient(Loop *loop, int sock);
+};
+
+#endif // MODBUSREACTOR_H
@@ -4,6 +4,7 @@
 #include <QLabel>
 #include <QLineEdit>
 #include <QKeyEvent>
+#include <QHeaderView>
 
 constexpr int WIN_HEIGHT = 440;
 constexpr int WIN_WIDTH = 910;
@@ -15,71 +16,33 @@ ModbusRegister::ModbusRegister() {
 
 
 void ModbusRegister::setAddrAndCount(int addr, int count){
-    int startCol = (addr / 10) * 10;
-    int base = 10;
-    if(mDisplayMode == DisplayMode::HEX){
-        base = 16;
-    }
-    for(int i = 1; i < 11; i++){
-        mValues[0][i] = startCol + (i-1) * 10;
-        mValues[i][0] = i - 1;
-        mTable[0][i]->setText(QString::number(mValues[0][i], base));
-        mTable[i][0]->setText(QString::number(mValues[i][0], base));
-    }
-
-    int rangeMin = addr;
-    int rangeMax = addr + count;
-    for(int row = 1; row < 11; row++){
-        for(int col = 1; col < 11; col++){
-            int addr = mValues[0][col] + mValues[row][0];
-            if(addr >= rangeMin && addr < rangeMax){
-                mTable[row][col]->setEnabled(true);
-            }else{
-                mTable[row][col]->setEnabled(false);
-            }
-        }
-    }
-}
-
-void ModbusRegister::flushTable(){
-
-    for(int row = 1; row < 11; row ++){
-        for(int col = 1; col < 11; col++){
-            QString val;
-            if(mDisplayMode == DisplayMode::HEX){
-                val = QString::asprintf("%04X", mValues[row][col]);
-            }else{
-                val = QString::number(mValues[row][col]);
-            }
-            mTable[row][col]->setText(val);
-        }
-    }
+    mModel.setAddrAndCount(addr, count);
 }
 
 
 void ModbusRegister::createWidget(){
-    const int eleWidth = 80;
-    const int eleHeight = 35;
     const int x_offset = 15;
     const int y_offset = 20;
-    for(int row = 0; row < 11; row++){
-        for(int col = 0; col < 11; col++){
-            mTable[row][col] = new QPushButton(this);
-            if(col == 0 || row == 0){
-                mTable[row][col]->setEnabled(false);
-                mTable[row][col]->setStyleSheet("background-color: transparent;");
-            }
-            mTable[row][col]->setGeometry(eleWidth * col + x_offset, eleHeight * row + y_offset, eleWidth, eleHeight);
-            connect(mTable[row][col], &QPushButton::clicked, this, [this, row, col]{
-                int addr = mValues[0][col] + mValues[row][0];
-                mEditAddrVal.setText(QString::number(addr));
-                mTxtEditValue.setText("");
-                mEditWin.show();
-            });
-            mValues[row][col] = 0;
+    mTable.setParent(this);
+    mTable.setGeometry(x_offset, y_offset, WIN_WIDTH - 2 * x_offset, WIN_HEIGHT - y_offset);
+    mTable.setModel(&mModel);
+    mTable.setSelectionMode(QAbstractItemView::NoSelection);
+    mTable.setEditTriggers(QAbstractItemView::NoEditTriggers);
+    mTable.horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    // 行高固定, 视图不需要逐行测量, 滚动到任意位置的代价都是常数
+    mTable.verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    mTable.verticalHeader()->setDefaultSectionSize(35);
+    mTable.setCornerButtonEnabled(false);
+    connect(&mTable, &QTableView::clicked, this, [this](const QModelIndex &index){
+        int addr = mModel.address(index);
+        if(addr < 0){
+            return;
         }
-    }
-    mTable[0][0]->setText("OFF/ADDR");
+        mEditAddrVal.setText(QString::number(addr));
+        mTxtEditValue.setText("");
+        mEditWin.show();
+        mEditWin.raise();
+    });
 }
 
 
@@ -90,14 +53,7 @@ void ModbusRegister::init(){
 }
 
 void ModbusRegister::setValues(int addr, const std::vector<uint16_t> &values){
-    int startcol = addr / 10;
-    for(uint16_t val : values){
-        int row = addr % 10 + 1;
-        int col = addr / 10 - startcol + 1;
-        mValues[row][col] = val;
-        addr++;
-    }
-    flushTable();
+    mModel.setValues(addr, values);
 }
 
 void ModbusRegister::createEditWin(){
@@ -161,15 +117,11 @@ void ModbusRegister::createEditWin(){
 }
 
 void ModbusRegister::disenableAllInput(){
-    for(auto &row : mTable){
-        for(auto &ele : row){
-            ele->setEnabled(false);
-        }
-    }
+    mModel.setEditable(false);
 }
 
 void ModbusRegister::setDisplayMode(DisplayMode mode){
-    mDisplayMode = mode;
+    mModel.setDisplayMode(mode);
 }
 
 
@@ -7,15 +7,15 @@
 #include <QLabel>
 #include <QLineEdit>
 #include <QKeyEvent>
+#include <QTableView>
+
+#include "registertablemodel.h"
 
 class ModbusRegister : public QWidget
 {
     Q_OBJECT
 public:
-    enum class DisplayMode{
-        DEC,
-        HEX
-    };
+    using DisplayMode = RegisterTableModel::DisplayMode;
     ModbusRegister();
     void setAddrAndCount(int addr, int count);
     void setValues(int addr, const std::vector<uint16_t> &values);
@@ -26,7 +26,6 @@ signals:
     void modifyValue(int addr, int value);
 
 private:
-    void flushTable();
     void createWidget();
     void init();
     void createEditWin();
@@ -34,9 +33,8 @@ private:
     void keyReleaseEvent(QKeyEvent *event) override;
 
 private:
-    std::array<std::array<QPushButton*, 11>, 11> mTable;
-    int mValues[11][11];
-    DisplayMode mDisplayMode = DisplayMode::DEC;
+    RegisterTableModel mModel;
+    QTableView mTable;
 
     QWidget mEditWin;
     QLabel mEditAddr;
@@ -1,41 +1,49 @@
 #include "modbusslave.h"
 #include "modbus.h"
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
 #include <memory>
 #include <iostream>
-#include <windows.h>
+#include <cerrno>
+#include <cstring>
 
 constexpr int TIME_OUT = 500;
+// 串口出错(如被拔出)后重试的间隔, 期间仍可被close立即唤醒
+constexpr int SERIAL_RETRY_MS = 200;
+// Windows上监听线程没有停止信号可等, 定期检查mFinish
+constexpr int ACCEPT_POLL_MS = 50;
+// accept因描述符耗尽等原因失败后重试的间隔, 连接仍在监听队列中
+constexpr int ACCEPT_RETRY_MS = 100;
+// RTU帧末尾的CRC长度, 广播只出现在RTU中
+constexpr int RTU_CRC_LENGTH = 2;
 
 ModbusSlave::ModbusSlave() {}
 
 void ModbusSlave::close()
 {
     mHandle.reset();
-    mMapping.reset();
+    mHoldRegisters.reset();
+    mInputRegisters.reset();
+    for (auto &unit : mUnits)
+    {
+        unit.reset();
+    }
+    mRouteUnits = false;
 }
 
 bool ModbusSlave::createRegisterMapping(const RegisterInfo &info)
 {
-    modbus_mapping_t *mapping = modbus_mapping_new_start_address(
-        0, 0,
-        0, 0,
-        info.holdRegister.addr, info.holdRegister.size,
-        info.inputRegister.addr, info.inputRegister.size);
-
-    if (!mapping)
+    if (info.holdRegister.size < 0 || info.inputRegister.size < 0)
     {
         return false;
     }
 
-    memset(mapping->tab_input_registers, 0, info.inputRegister.size * 2);
-    memset(mapping->tab_registers, 0, info.holdRegister.size * 2);
-
     mRegisterInfo = info;
 
-    mMapping.reset(mapping, [](modbus_mapping_t *mapping)
-                   { modbus_mapping_free(mapping); });
+    mHoldRegisters = std::make_shared<RegisterBank>(info.holdRegister.addr, info.holdRegister.size);
+    mInputRegisters = std::make_shared<RegisterBank>(info.inputRegister.addr, info.inputRegister.size);
     return true;
 }
 
@@ -46,106 +54,399 @@ void ModbusSlave::setSlave(int slaveId)
 
 uint16_t ModbusSlave::readHoldRegister(unsigned int addr)
 {
-    if (!mHandle || !mMapping)
+    uint16_t value = 0;
+    if (mHandle && mHoldRegisters)
     {
-        return 0;
-    }
-    if (legalAddress(addr, AddrType::HOLD_REGISTER))
-    {
-        return mMapping->tab_registers[addr - mMapping->start_registers];
+        mHoldRegisters->read(addr, 1, &value);
     }
-    return 0;
+    return value;
 }
 
 std::vector<uint16_t> ModbusSlave::readHoldRegister(unsigned int addr, unsigned int len)
 {
-    if (!mHandle || !mMapping)
+    if (!mHandle || !mHoldRegisters)
     {
         return {};
     }
-    if (legalAddress(addr, AddrType::HOLD_REGISTER) && legalAddress(addr + len - 1, AddrType::HOLD_REGISTER))
+    return mHoldRegisters->read(addr, len);
+}
+
+uint16_t ModbusSlave::readInputRegister(unsigned int addr)
+{
+    uint16_t value = 0;
+    if (mHandle && mInputRegisters)
     {
-        int offset = addr - mMapping->start_registers;
-        return std::vector<uint16_t>(mMapping->tab_registers + offset, mMapping->tab_registers + offset + len);
+        mInputRegisters->read(addr, 1, &value);
     }
-    else
+    return value;
+}
+
+std::vector<uint16_t> ModbusSlave::readInputRegister(unsigned int addr, unsigned int len)
+{
+    if (!mHandle || !mInputRegisters)
     {
         return {};
     }
+    return mInputRegisters->read(addr, len);
 }
 
-uint16_t ModbusSlave::readInputRegister(unsigned int addr)
+bool ModbusSlave::addUnit(int unitId, const RegisterInfo &info)
 {
-    if (!mHandle || !mMapping)
+    // 分发时不加锁读取mUnits, 运行中不允许修改
+    if (mHandle || unitId < 0 || unitId >= MAX_UNITS || info.holdRegister.size < 0 || info.inputRegister.size < 0)
     {
-        return 0;
+        return false;
+    }
+    auto unit = std::make_unique<Unit>();
+    unit->holdRegisters = std::make_shared<RegisterBank>(info.holdRegister.addr, info.holdRegister.size);
+    unit->inputRegisters = std::make_shared<RegisterBank>(info.inputRegister.addr, info.inputRegister.size);
+    mUnits[unitId] = std::move(unit);
+    mRouteUnits = true;
+    return true;
+}
+
+std::shared_ptr<RegisterBank> ModbusSlave::unitBank(int unitId, AddrType type) const
+{
+    if (unitId == -1)
+    {
+        return type == AddrType::HOLD_REGISTER ? mHoldRegisters : mInputRegisters;
     }
-    if (legalAddress(addr, AddrType::INPUT_REGISTER))
+    if (unitId < 0 || unitId >= MAX_UNITS || !mUnits[unitId])
     {
-        return mMapping->tab_input_registers[addr - mMapping->start_input_registers];
+        return nullptr;
     }
-    return 0;
+    const Unit &unit = *mUnits[unitId];
+    return type == AddrType::HOLD_REGISTER ? unit.holdRegisters : unit.inputRegisters;
 }
 
-std::vector<uint16_t> ModbusSlave::readInputRegister(unsigned int addr, unsigned int len)
+bool ModbusSlave::addRegisterWindow(AddrType type, int addr, int size, int unitId)
 {
-    if (!mHandle || !mMapping)
+    if (unitId >= 0)
     {
-        return {};
+        std::shared_ptr<RegisterBank> regs = unitBank(unitId, type);
+        return regs && regs->addWindow(addr, size);
     }
-    if (legalAddress(addr, AddrType::INPUT_REGISTER) && legalAddress(addr + len - 1, AddrType::INPUT_REGISTER))
+    std::shared_ptr<RegisterBank> &regs = type == AddrType::HOLD_REGISTER ? mHoldRegisters : mInputRegisters;
+    if (!regs)
     {
-        int offset = addr - mMapping->start_input_registers;
-        return std::vector<uint16_t>(mMapping->tab_input_registers + offset, mMapping->tab_input_registers + offset + len);
+        // 分发时不加锁读取寄存器组指针, 运行中只能往已有的寄存器组里加窗口
+        if (mHandle)
+        {
+            return false;
+        }
+        regs = std::make_shared<RegisterBank>();
     }
-    else
+    return regs->addWindow(addr, size);
+}
+
+bool ModbusSlave::shareRegisters(const std::string &name, int mode)
+{
+    if (mHandle || name.empty())
     {
-        return {};
+        return false;
+    }
+    if (!mHoldRegisters)
+    {
+        mHoldRegisters = std::make_shared<RegisterBank>();
+    }
+    if (!mInputRegisters)
+    {
+        mInputRegisters = std::make_shared<RegisterBank>();
     }
+    return mHoldRegisters->openShared(name + "_hr", mode) && mInputRegisters->openShared(name + "_ir", mode);
 }
 
-void ModbusSlave::writeHoldRegister(unsigned int addr, const std::vector<uint16_t> &values)
+int ModbusSlave::readChangedRegister(AddrType type, unsigned int addr, unsigned int len,
+                                     std::vector<uint32_t> &versions, std::vector<uint16_t> &values)
 {
-    if (!mHandle || !mMapping)
+    RegisterBank *regs = bank(type);
+    if (!mHandle || !regs)
     {
-        return;
+        return -1;
     }
-    if (legalAddress(addr, AddrType::HOLD_REGISTER))
+    if (values.size() != len)
     {
-        int offset = addr - mMapping->start_registers;
-        std::copy(values.begin(), values.end(), mMapping->tab_registers + offset);
+        values.assign(len, 0);
+        versions.clear();
     }
+    return regs->readChanged(addr, len, values.data(), versions);
 }
 
-void ModbusSlave::writeInputRegister(unsigned int addr, const std::vector<uint16_t> &values)
+void ModbusSlave::writeHoldRegister(unsigned int addr, const std::vector<uint16_t> &values)
 {
-    if (!mHandle || !mMapping)
+    if (mHandle && mHoldRegisters)
     {
-        return;
+        mHoldRegisters->write(addr, values);
     }
-    if (legalAddress(addr, AddrType::INPUT_REGISTER))
+}
+
+void ModbusSlave::writeInputRegister(unsigned int addr, const std::vector<uint16_t> &values)
+{
+    if (mHandle && mInputRegisters)
     {
-        int offset = addr - mMapping->start_input_registers;
-        std::copy(values.begin(), values.end(), mMapping->tab_input_registers + offset);
+        mInputRegisters->write(addr, values);
     }
 }
 
-bool ModbusSlave::legalAddress(int addr, AddrType type)
+RegisterBank *ModbusSlave::bank(AddrType type) const
 {
-    int startAddr = 0;
-    int endAddr = 0;
     switch (type)
     {
     case AddrType::HOLD_REGISTER:
-        startAddr = mRegisterInfo.holdRegister.addr;
-        endAddr = startAddr + mRegisterInfo.holdRegister.size;
-        break;
+        return mHoldRegisters.get();
     case AddrType::INPUT_REGISTER:
-        startAddr = mRegisterInfo.inputRegister.addr;
-        endAddr = startAddr + mRegisterInfo.inputRegister.size;
+        return mInputRegisters.get();
+    }
+    return nullptr;
+}
+
+bool ModbusSlave::setFunctionHandler(int function, FunctionHandler handler)
+{
+    if (mHandle || function < 1 || function > MAX_FUNCTION_CODE)
+    {
+        return false;
+    }
+    if (!mReplyTable)
+    {
+        mReplyTable.reset(modbus_reply_table_new());
+        if (!mReplyTable)
+        {
+            return false;
+        }
+    }
+    mFunctionHandlers[function] = std::move(handler);
+    return modbus_reply_table_set(mReplyTable.get(), function, mFunctionHandlers[function] ? dispatchFunction : nullptr,
+                                  this) == 0;
+}
+
+int ModbusSlave::dispatchFunction(modbus_t *ctx, const uint8_t *req, int len, uint8_t *rsp,
+                                  modbus_mapping_t *, void *userData)
+{
+    auto *slave = static_cast<ModbusSlave *>(userData);
+    const int offset = modbus_get_header_length(ctx);
+    RegisterBank *hold = nullptr;
+    RegisterBank *input = nullptr;
+    // reply()已经拒绝了无法路由的单元号
+    slave->route(req[offset - 1], hold, input);
+    return slave->mFunctionHandlers[req[offset]](req[offset - 1], req + offset + 1, len - offset - 1, rsp, hold, input);
+}
+
+bool ModbusSlave::route(int unitId, RegisterBank *&hold, RegisterBank *&input) const
+{
+    hold = mHoldRegisters.get();
+    input = mInputRegisters.get();
+    if (mRouteUnits)
+    {
+        const Unit *unit = mUnits[unitId].get();
+        if (unit)
+        {
+            hold = unit->holdRegisters.get();
+            input = unit->inputRegisters.get();
+        }
+    }
+    return hold && input;
+}
+
+int ModbusSlave::reply(modbus_t *ctx, const uint8_t *req, int len)
+{
+    const int offset = modbus_get_header_length(ctx);
+    // RTU(头部只有地址一个字节)的广播不应答
+    const bool broadcast = offset == 1 && req[0] == MODBUS_BROADCAST_ADDRESS;
+    // 功能码要求的字段不全时不能按字段读取请求(applyWrite/自定义处理函数), 调用方未校验帧长时也不越界
+    int expected = modbus_get_indication_length(ctx, req, len);
+    if (expected <= 0 || len < expected)
+    {
+        return broadcast ? 0 : modbus_reply_exception(ctx, req, MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE);
+    }
+    if (mRouteUnits && broadcast)
+    {
+        replyBroadcast(ctx, req, len);
+        return 0;
+    }
+
+    RegisterBank *hold = nullptr;
+    RegisterBank *input = nullptr;
+    if (!route(req[offset - 1], hold, input))
+    {
+        return mRouteUnits && !broadcast ? modbus_reply_exception(ctx, req, MODBUS_EXCEPTION_GATEWAY_TARGET) : -1;
+    }
+    return reply(ctx, req, len, hold, input);
+}
+
+void ModbusSlave::replyBroadcast(modbus_t *ctx, const uint8_t *req, int len)
+{
+    // 总线上的每台设备都执行广播的写请求, 包括setSlave地址使用的寄存器组
+    const uint8_t function = req[1];
+    auto apply = [&](RegisterBank *hold, RegisterBank *input)
+    {
+        if (!hold || !input)
+        {
+            return;
+        }
+        if (function <= MAX_FUNCTION_CODE && mFunctionHandlers[function])
+        {
+            // 自定义功能码经分发表只能路由到一个单元, 这里直接调用, 应答丢弃;
+            // 与dispatchFunction一致, 传给处理函数的数据不含地址、功能码和CRC
+            uint8_t rsp[MODBUS_MAX_PDU_LENGTH];
+            mFunctionHandlers[function](MODBUS_BROADCAST_ADDRESS, req + 2, len - 2 - RTU_CRC_LENGTH, rsp, hold,
+                                        input);
+            return;
+        }
+        // modbus_reply不发送RTU广播的应答
+        reply(ctx, req, len, hold, input);
+    };
+
+    // 与回复掩码一致: 该地址也添加了单元时, 总线上只有那个单元
+    if (mSlaveId >= 0 && mSlaveId < MAX_UNITS && !mUnits[mSlaveId])
+    {
+        apply(mHoldRegisters.get(), mInputRegisters.get());
+    }
+    for (auto &unit : mUnits)
+    {
+        if (unit)
+        {
+            apply(unit->holdRegisters.get(), unit->inputRegisters.get());
+        }
+    }
+}
+
+int ModbusSlave::reply(modbus_t *ctx, const uint8_t *req, int len, RegisterBank *hold, RegisterBank *input)
+{
+    const int offset = modbus_get_header_length(ctx);
+    if (mReplyTable)
+    {
+        // 表只有一份, 所有连接共用; 设置一个指针的开销可以忽略
+        modbus_set_reply_table(ctx, mReplyTable.get());
+        if (req[offset] <= MAX_FUNCTION_CODE && mFunctionHandlers[req[offset]])
+        {
+            modbus_mapping_t empty{};
+            return modbus_reply(ctx, req, len, &empty);
+        }
+    }
+
+    // modbus_reply只认识modbus_mapping_t, 这里给每个线程准备一份只覆盖本次请求区间的寄存器视图:
+    // 读请求把要读的区间从寄存器组无锁拷贝到视图里; 写请求先在寄存器组的页锁内完成读-改-写并提交,
+    // 之后才由modbus_reply生成应答, 并发的掩码写不会丢失更新, 主站收到确认时新值已对所有读者可见.
+    // 区间含有未映射的地址时视图为空, 由modbus_reply回复ILLEGAL_DATA_ADDRESS.
+    thread_local std::vector<uint16_t> holdView;
+    thread_local std::vector<uint16_t> inputView;
+
+    auto word = [req, offset](int pos)
+    { return (req[offset + pos] << 8) | req[offset + pos + 1]; };
+
+    // 与modbus_reply相同的数量判断, 数量非法时不拷贝, 交给modbus_reply回复异常
+    int readAddr = 0;
+    int readCnt = 0;
+    int writeAddr = 0;
+    int writeCnt = 0;
+    RegisterBank *readBank = hold;
+    switch (req[offset])
+    {
+    case MODBUS_FC_READ_HOLDING_REGISTERS:
+    case MODBUS_FC_READ_INPUT_REGISTERS:
+        if (word(3) >= 1 && word(3) <= MODBUS_MAX_READ_REGISTERS)
+        {
+            readBank = req[offset] == MODBUS_FC_READ_HOLDING_REGISTERS ? hold : input;
+            readAddr = word(1);
+            readCnt = word(3);
+        }
+        break;
+    case MODBUS_FC_WRITE_SINGLE_REGISTER:
+        writeAddr = word(1);
+        writeCnt = 1;
+        break;
+    case MODBUS_FC_MASK_WRITE_REGISTER:
+        writeAddr = word(1);
+        writeCnt = 1;
+        break;
+    case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        if (word(3) >= 1 && word(3) <= MODBUS_MAX_WRITE_REGISTERS && req[offset + 5] == word(3) * 2)
+        {
+            writeAddr = word(1);
+            writeCnt = word(3);
+        }
+        break;
+    case MODBUS_FC_WRITE_AND_READ_REGISTERS:
+        if (word(3) >= 1 && word(3) <= MODBUS_MAX_WR_READ_REGISTERS &&
+            word(7) >= 1 && word(7) <= MODBUS_MAX_WR_WRITE_REGISTERS && req[offset + 9] == word(7) * 2)
+        {
+            readAddr = word(1);
+            readCnt = word(3);
+            writeAddr = word(5);
+            writeCnt = word(7);
+        }
+        break;
+    default:
         break;
     }
-    return (addr >= startAddr && addr < endAddr);
+
+    // 按功能码把请求中的写入值应用到寄存器当前值上
+    const uint8_t function = req[offset];
+    auto applyWrite = [&](uint16_t *values)
+    {
+        switch (function)
+        {
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+            values[0] = static_cast<uint16_t>(word(3));
+            break;
+        case MODBUS_FC_MASK_WRITE_REGISTER:
+            values[0] = static_cast<uint16_t>((values[0] & word(3)) | (word(5) & ~word(3)));
+            break;
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+            for (int i = 0; i < writeCnt; i++)
+            {
+                values[i] = static_cast<uint16_t>(word(6 + i * 2));
+            }
+            break;
+        case MODBUS_FC_WRITE_AND_READ_REGISTERS:
+            for (int i = 0; i < writeCnt; i++)
+            {
+                values[i] = static_cast<uint16_t>(word(10 + i * 2));
+            }
+            break;
+        default:
+            break;
+        }
+    };
+
+    modbus_mapping_t view{};
+    if (readCnt > 0 || writeCnt > 0)
+    {
+        // 视图覆盖读写两个区间, 两者都已映射才有效
+        bool valid = (readCnt == 0 || readBank->contains(readAddr, readCnt)) &&
+                     (writeCnt == 0 || hold->contains(writeAddr, writeCnt));
+        int first = writeCnt == 0 ? readAddr : (readCnt == 0 ? writeAddr : std::min(readAddr, writeAddr));
+        int last = writeCnt == 0 ? readAddr + readCnt
+                                 : (readCnt == 0 ? writeAddr + writeCnt : std::max(readAddr + readCnt, writeAddr + writeCnt));
+        std::vector<uint16_t> &buf = readBank == input ? inputView : holdView;
+        if (valid)
+        {
+            buf.resize(last - first);
+            if (writeCnt > 0)
+            {
+                hold->update(writeAddr, writeCnt, applyWrite);
+            }
+            // 读写同时进行(FC23)时先写后读, 读到的值包含本次写入
+            if (readCnt > 0)
+            {
+                readBank->read(readAddr, readCnt, buf.data() + readAddr - first);
+            }
+        }
+        if (readBank == input && readCnt > 0)
+        {
+            view.start_input_registers = first;
+            view.nb_input_registers = valid ? last - first : 0;
+            view.tab_input_registers = buf.data();
+        }
+        else
+        {
+            view.start_registers = first;
+            view.nb_registers = valid ? last - first : 0;
+            view.tab_registers = buf.data();
+        }
+    }
+
+    return modbus_reply(ctx, req, len, &view);
 }
 
 bool ModbusSlaveTCP::open()
@@ -159,49 +460,186 @@ bool ModbusSlaveTCP::open()
     mSockServ = modbus_tcp_listen(handle, LISTEN_LIST_LEN);
     if (mSockServ == -1)
     {
+        modbus_free(handle);
         return false;
     }
 
     modbus_set_slave(handle, mSlaveId);
-    mListenThread = std::make_unique<std::thread>(&ModbusSlaveTCP::tcpListen, this);
+    mFinish = false;
+    auto handler = [this](modbus_t *ctx, const uint8_t *req, int len)
+    { return reply(ctx, req, len); };
+    if (mSharedReactor)
+    {
+        if (!mReactor || !mReactor->addListener(mSockServ, handler))
+        {
+            platform::closeSocket(mSockServ);
+            mSockServ = platform::INVALID_SOCK;
+            modbus_free(handle);
+            return false;
+        }
+    }
+    else if (mServerMode == ServerMode::REACTOR && ModbusTcpReactor::supported())
+    {
+        mReactor = std::make_shared<ModbusTcpReactor>(mReactorThreads);
+        if (!mReactor->start(mSockServ, handler))
+        {
+            mReactor.reset();
+            platform::closeSocket(mSockServ);
+            mSockServ = platform::INVALID_SOCK;
+            modbus_free(handle);
+            return false;
+        }
+    }
+    else
+    {
+#if !defined(_WIN32)
+        if (!platform::openWakeup(mWakeup))
+        {
+            platform::closeSocket(mSockServ);
+            mSockServ = platform::INVALID_SOCK;
+            modbus_free(handle);
+            return false;
+        }
+#endif
+        mListenThread = std::make_unique<std::thread>(&ModbusSlaveTCP::tcpListen, this, handle);
+    }
     mHandle.reset(handle, [this](modbus_t *handle)
-                  { mFinish = true;
+                  { {
+                        // 持锁设置, 避免与等待空闲槽位的监听线程错过通知
+                        std::lock_guard<std::mutex> lock(mPoolMutex);
+                        mFinish = true;
+                    }
+                    mSlotCond.notify_all();
+                    if(mSharedReactor){
+                        mReactor->removeListener(mSockServ);
+                    }else if(mReactor){
+                        mReactor->stop();
+                        mReactor.reset();
+                    }
                     if(mListenThread && mListenThread->joinable()){
+#if !defined(_WIN32)
+                        platform::signalWakeup(mWakeup);
+#endif
                         mListenThread->join();
+#if !defined(_WIN32)
+                        platform::closeWakeup(mWakeup);
+#endif
                     }
-                    mListenThread.release();
-                    if(mSockServ != INVALID_SOCKET){
-                        closesocket(mSockServ);
-                        mSockServ = INVALID_SOCKET;
+                    mListenThread.reset();
+                    if(mSockServ != platform::INVALID_SOCK){
+                        platform::closeSocket(mSockServ);
+                        mSockServ = platform::INVALID_SOCK;
                     }
                     modbus_free(handle); });
     return true;
 }
 
-void ModbusSlaveTCP::tcpListen()
+void ModbusSlaveTCP::tcpListen(modbus_t *handle)
 {
-    u_long mode = 1;
-    if (ioctlsocket(mSockServ, FIONBIO, &mode) != 0)
+    if (!platform::setNonBlocking(mSockServ))
     {
         return;
     }
 
-    std::vector<std::unique_ptr<std::thread>> masters;
     while (!mFinish)
     {
-        int sock_client = modbus_tcp_accept(mHandle.get(), &mSockServ);
+        {
+            // 连接数已满时不再accept, 新连接留在监听队列中, 直到有连接断开
+            std::unique_lock<std::mutex> lock(mPoolMutex);
+            mSlotCond.wait(lock, [this]
+                           { return mBusyWorkers < mMaxClients || mFinish; });
+            if (mFinish)
+            {
+                break;
+            }
+        }
+
+#if !defined(_WIN32)
+        // 阻塞在监听套接字和停止信号上, 有连接到达或close时立即返回
+        int ready = platform::waitReadable(mSockServ, mWakeup, -1);
+        if (ready == -1)
+        {
+            platform::waitReadable(mWakeup.readFd, mWakeup, ACCEPT_RETRY_MS);
+        }
+#else
+        int ready = platform::waitReadable(mSockServ, ACCEPT_POLL_MS);
+#endif
+        if (ready <= 0)
+        {
+            continue;
+        }
+        int sock_client = modbus_tcp_accept(handle, &mSockServ);
         if (sock_client == -1)
         {
-            Sleep(50);
+            // 连接已被取走或中途断开时直接重试; 描述符耗尽(EMFILE/ENFILE)等错误时监听套接字一直可读,
+            // 等一段时间再试, 避免空转
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+            {
+#if !defined(_WIN32)
+                platform::waitReadable(mWakeup.readFd, mWakeup, ACCEPT_RETRY_MS);
+#else
+                platform::sleepMs(ACCEPT_RETRY_MS);
+#endif
+            }
             continue;
         }
 
-        masters.emplace_back(std::make_unique<std::thread>(&ModbusSlaveTCP::handleClient, this, sock_client));
+        // 优先交给空闲的工作线程, 没有时才创建新线程, 线程数不超过mMaxClients
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        mBusyWorkers++;
+        auto idle = std::find_if(mWorkers.begin(), mWorkers.end(), [](const std::unique_ptr<Worker> &worker)
+                                 { return worker->sock == platform::INVALID_SOCK; });
+        if (idle != mWorkers.end())
+        {
+            (*idle)->sock = sock_client;
+            mWorkerCond.notify_all();
+        }
+        else
+        {
+            mWorkers.push_back(std::make_unique<Worker>());
+            Worker *worker = mWorkers.back().get();
+            worker->sock = sock_client;
+            worker->thread = std::make_unique<std::thread>(&ModbusSlaveTCP::workerLoop, this, worker);
+        }
     }
 
-    for (auto &master : masters)
+    // 断开所有连接, 阻塞在接收上的工作线程随即返回
+    {
+        std::lock_guard<std::mutex> lock(mPoolMutex);
+        for (auto &worker : mWorkers)
+        {
+            platform::shutdownSocket(worker->sock);
+        }
+    }
+    mWorkerCond.notify_all();
+    for (auto &worker : mWorkers)
     {
-        master->join();
+        worker->thread->join();
+    }
+    mWorkers.clear();
+    mBusyWorkers = 0;
+}
+
+void ModbusSlaveTCP::workerLoop(Worker *worker)
+{
+    std::unique_lock<std::mutex> lock(mPoolMutex);
+    while (true)
+    {
+        mWorkerCond.wait(lock, [this, worker]
+                         { return worker->sock != platform::INVALID_SOCK || mFinish; });
+        if (worker->sock == platform::INVALID_SOCK)
+        {
+            break;
+        }
+        int sock = worker->sock;
+        lock.unlock();
+        handleClient(sock);
+        lock.lock();
+        // 持锁关闭, 避免停止时对已被复用的描述符调用shutdown
+        platform::closeSocket(sock);
+        worker->sock = platform::INVALID_SOCK;
+        mBusyWorkers--;
+        mSlotCond.notify_one();
     }
 }
 
@@ -211,7 +649,6 @@ void ModbusSlaveTCP::handleClient(int sock_client)
     modbus_t *client_handle = modbus_new_tcp(nullptr, 0);
     if (!client_handle)
     {
-        closesocket(sock_client);
         return;
     }
 
@@ -223,8 +660,13 @@ void ModbusSlaveTCP::handleClient(int sock_client)
 
     // 设置此客户端的套接字
     modbus_set_socket(client_handle, sock_client);
+    platform::setNoDelay(sock_client);
 
-    // modbus_set_indication_timeout(client_handle, 0, TIME_OUT * 1000);
+    // 超过空闲时间没有请求时modbus_receive超时返回, 断开连接让出槽位
+    if (mIdleTimeoutMs > 0)
+    {
+        modbus_set_indication_timeout(client_handle, mIdleTimeoutMs / 1000, (mIdleTimeoutMs % 1000) * 1000);
+    }
 
     while (!mFinish)
     {
@@ -232,28 +674,37 @@ void ModbusSlaveTCP::handleClient(int sock_client)
 
         // 接收查询请求
         int rc = modbus_receive(client_handle, query);
+        if (rc == -1 && errno == EMBBADDATA)
+        {
+            // 畸形请求已被丢弃, 不应答, 继续接收下一个
+            continue;
+        }
         if (rc == -1)
         {
             // 如果是超时或断开连接，退出循环
             break;
         }
 
-        // 加锁以确保对共享映射的安全访问
+        // 处理并回复请求; 主站流水线发来的请求已在缓冲区中时一并处理, 应答合并发送
+        modbus_tcp_set_cork(client_handle, 1);
+        bool ok = reply(client_handle, query, rc) != -1;
+        while (ok && modbus_tcp_has_indication(client_handle) == 1)
         {
-            std::lock_guard<std::mutex> lock(mMappingMutex);
-            // 处理并回复请求
-            int reply_rc = modbus_reply(client_handle, query, rc, mMapping.get());
-            if (reply_rc == -1)
+            rc = modbus_receive(client_handle, query);
+            if (rc == -1 && errno == EMBBADDATA)
             {
-                break;
+                continue;
             }
+            ok = rc != -1 && reply(client_handle, query, rc) != -1;
+        }
+        if (modbus_tcp_set_cork(client_handle, 0) == -1 || !ok)
+        {
+            break;
         }
     }
 
-    // 清理资源
-    modbus_close(client_handle);
+    // 套接字由workerLoop关闭
     modbus_free(client_handle);
-    closesocket(sock_client);
 }
 
 void ModbusSlaveTCP::setLocalPort(const std::string &ip, int port)
@@ -262,6 +713,24 @@ void ModbusSlaveTCP::setLocalPort(const std::string &ip, int port)
     mPort = port;
 }
 
+void ModbusSlaveTCP::setServerMode(ServerMode mode, int reactorThreads)
+{
+    mServerMode = mode;
+    mReactorThreads = reactorThreads;
+}
+
+void ModbusSlaveTCP::setClientLimits(int maxClients, int idleTimeoutMs)
+{
+    mMaxClients = std::max(1, maxClients);
+    mIdleTimeoutMs = std::max(0, idleTimeoutMs);
+}
+
+void ModbusSlaveTCP::setReactor(std::shared_ptr<ModbusTcpReactor> reactor)
+{
+    mReactor = std::move(reactor);
+    mSharedReactor = mReactor != nullptr;
+}
+
 void ModbusSlaveRTU::setTarget(const std::string &com, int baud, char parity, int databits, int stopbits)
 {
     mCom = com;
@@ -271,9 +740,25 @@ void ModbusSlaveRTU::setTarget(const std::string &com, int baud, char parity, in
     mStopBits = stopbits;
 }
 
+#if !defined(_WIN32)
+void ModbusSlaveRTU::setVirtualBus(const std::string &link)
+{
+    mVirtualBus = true;
+    mBusLink = link;
+}
+#endif
+
 bool ModbusSlaveRTU::open()
 {
-    modbus_t *ctx = modbus_new_rtu(mCom.c_str(), mBaud, mParity, mDataBits, mStopBits);
+    std::string device = mCom;
+#if !defined(_WIN32)
+    if (mVirtualBus)
+    {
+        // 每次打开/dev/ptmx都会新建一对伪终端, 得到的就是主端
+        device = "/dev/ptmx";
+    }
+#endif
+    modbus_t *ctx = modbus_new_rtu(device.c_str(), mBaud, mParity, mDataBits, mStopBits);
     if (!ctx)
     {
         return false;
@@ -286,59 +771,115 @@ bool ModbusSlaveRTU::open()
     }
 
     modbus_set_slave(ctx, mSlaveId);
+    if (mRouteUnits)
+    {
+        // 按地址分发: 每个单元是总线上的一台设备
+        uint8_t mask[MAX_UNITS / 8] = {};
+        for (int unitId = 0; unitId < MAX_UNITS; unitId++)
+        {
+            if (mUnits[unitId] || (unitId == mSlaveId && mHoldRegisters))
+            {
+                mask[unitId / 8] |= 1 << (unitId % 8);
+            }
+        }
+        modbus_rtu_set_slave_mask(ctx, mask);
+    }
+
+#if !defined(_WIN32)
+    if (mVirtualBus)
+    {
+        mBusPort = platform::openPseudoTerminalPeer(modbus_get_socket(ctx), mBusLink, mBusPeer);
+        if (mBusPort.empty())
+        {
+            modbus_close(ctx);
+            modbus_free(ctx);
+            return false;
+        }
+    }
+    if (!platform::openWakeup(mWakeup))
+    {
+        if (mVirtualBus)
+        {
+            platform::closePseudoTerminalPeer(mBusPeer, mBusLink);
+            mBusPeer = -1;
+            mBusPort.clear();
+        }
+        modbus_close(ctx);
+        modbus_free(ctx);
+        return false;
+    }
+#endif
 
-    mReplyMaster = std::make_unique<std::thread>(&ModbusSlaveRTU::replyMaster, this);
+    mFinish = false;
     mHandle.reset(ctx, [this](modbus_t *ctx)
-                  { 
+                  {
                     mFinish = true;
+#if !defined(_WIN32)
+                    platform::signalWakeup(mWakeup);
+#endif
                     mReplyMaster->join();
-                    mReplyMaster.release();
+                    mReplyMaster.reset();
                     modbus_close(ctx);
-                    modbus_free(ctx); });
+                    modbus_free(ctx);
+#if !defined(_WIN32)
+                    platform::closeWakeup(mWakeup);
+                    if (mVirtualBus)
+                    {
+                        platform::closePseudoTerminalPeer(mBusPeer, mBusLink);
+                        mBusPeer = -1;
+                        mBusPort.clear();
+                    }
+#endif
+                  });
+    mReplyMaster = std::make_unique<std::thread>(&ModbusSlaveRTU::replyMaster, this, ctx);
 
     return true;
 }
 
-void ModbusSlaveRTU::replyMaster()
+void ModbusSlaveRTU::replyMaster(modbus_t *ctx)
 {
-    // 设置短的响应超时时间，这样可以快速检测是否有数据到达
-    uint32_t response_timeout = TIME_OUT * 1000;
+    uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
 
-    modbus_set_indication_timeout(mHandle.get(), 0, response_timeout);
+    // 只有串口可读时才开始接收, 这里的超时只是保护, 正常情况下select会立即返回
+    modbus_set_indication_timeout(ctx, 0, TIME_OUT * 1000);
 
+#if defined(_WIN32)
+    // Windows的串口句柄不能poll, 靠指示超时定期检查mFinish
     while (!mFinish)
     {
-        uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
-
-        // 非阻塞接收查询请求（通过设置短超时时间实现）
-        int rc = modbus_receive(mHandle.get(), query);
-        if (rc == -1)
+        int rc = modbus_receive(ctx, query);
+        if (rc == -1 && errno != ETIMEDOUT)
         {
-            // 如果是因为超时（没有数据到达），继续循环
-            // 在Windows上，libmodbus使用超时机制而不是真正的非阻塞I/O
-            Sleep(10); // 短暂休眠，避免CPU占用过高
+            platform::sleepMs(SERIAL_RETRY_MS);
             continue;
         }
-
-        // 处理并回复请求
-        int reply_rc = modbus_reply(mHandle.get(), query, rc, mMapping.get());
-        if (reply_rc == -1)
+        if (rc > 0)
         {
-            continue; // 继续监听下一个请求
+            reply(ctx, query, rc);
         }
     }
-}
-
-const uint16_t* ModbusSlave::getHoldRegisters() const{
-    if(mMapping){
-        return mMapping->tab_registers;
-    }
-    return nullptr;
-}
+#else
+    // 阻塞在串口和停止信号上: 有数据时立即处理, close时立即退出, 空闲时不占CPU
+    const int fd = modbus_get_socket(ctx);
+    while (!mFinish)
+    {
+        int ready = platform::waitReadable(fd, mWakeup, -1);
+        if (ready == 0)
+        {
+            continue;
+        }
+        if (ready == -1)
+        {
+            platform::waitReadable(mWakeup.readFd, mWakeup, SERIAL_RETRY_MS);
+            continue;
+        }
 
-const uint16_t* ModbusSlave::getInputRegisters() const{
-    if(mMapping){
-        return mMapping->tab_input_registers;
+        // CRC错误等协议错误不需要等待, 直接接收下一帧
+        int rc = modbus_receive(ctx, query);
+        if (rc > 0)
+        {
+            reply(ctx, query, rc);
+        }
     }
-    return nullptr;
+#endif
 }
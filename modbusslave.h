@@ -1,13 +1,21 @@
 #ifndef MODBUSSLAVE_H
 #define MODBUSSLAVE_H
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <uchar.h>
 #include <vector>
 #include <thread>
 
 #include "modbus.h"
-#include <winsock2.h>
+#include "modbusreactor.h"
+#include "platform.h"
+#include "registerbank.h"
 
 class ModbusSlave
 {
@@ -43,48 +51,142 @@ public:
     uint16_t readInputRegister(unsigned int addr);
     std::vector<uint16_t> readInputRegister(unsigned int addr, unsigned int len);
 
+    // 增量读取: 只刷新values中自上次调用后被写过的部分, 返回刷新的寄存器数
+    int readChangedRegister(AddrType type, unsigned int addr, unsigned int len,
+                            std::vector<uint32_t> &versions, std::vector<uint16_t> &values);
+
+    // 多单元模式: 按请求中的单元号把请求分发到各自的寄存器组, 一个端口模拟网关后面的整条总线.
+    // 需在open之前调用; 未添加的单元号使用createRegisterMapping创建的寄存器组,
+    // 没有创建时回复"网关目标设备无响应"异常
+    static constexpr int MAX_UNITS = 256;
+    bool addUnit(int unitId, const RegisterInfo &info);
+    // unitId为-1时返回createRegisterMapping创建的寄存器组
+    std::shared_ptr<RegisterBank> unitBank(int unitId, AddrType type) const;
+
+    // 在寄存器组中再映射一个地址窗口, 一个从站可以有任意多个不连续的窗口, 运行中也可以调用.
+    // unitId为-1时作用于createRegisterMapping创建的寄存器组, 否则作用于addUnit添加的单元
+    bool addRegisterWindow(AddrType type, int addr, int size, int unitId = -1);
+
+    // 把保持寄存器和输入寄存器放到具名共享内存name + "_hr"和name + "_ir"中(布局见RegisterBank),
+    // 外部进程直接写内存即可更新寄存器, 不需要经过Modbus. 需在createRegisterMapping之后, open之前调用;
+    // mode为新建共享内存的权限, 默认只有本用户可以访问
+    bool shareRegisters(const std::string &name, int mode = platform::SHARED_MEMORY_MODE);
+
     void writeHoldRegister(unsigned int addr, const std::vector<uint16_t> &values);
     void writeInputRegister(unsigned int addr, const std::vector<uint16_t> &values);
 
-    const uint16_t* getHoldRegisters() const;
-    const uint16_t* getInputRegisters() const;
+    // 自定义功能码: 替换或新增libmodbus分发表中一个功能码的处理, 在收包线程中直接处理原始请求, 不做额外拷贝.
+    // pdu为请求中功能码之后的数据, 应答数据(不含功能码)直接写入rsp, 最多252字节;
+    // 返回应答数据长度, 或者负的异常码(如-MODBUS_EXCEPTION_ILLEGAL_DATA_ADDRESS).
+    // hold/input为按单元号路由后的寄存器组. 需在open之前调用, handler为空时恢复默认处理
+    using FunctionHandler = std::function<int(int unitId, const uint8_t *pdu, int pduLength, uint8_t *rsp,
+                                              RegisterBank *hold, RegisterBank *input)>;
+    static constexpr int MAX_FUNCTION_CODE = 0x7F;
+    bool setFunctionHandler(int function, FunctionHandler handler);
 
 protected:
     static constexpr int UNSET_SLAVE_ID = -1;
+    // 连接的modbus_t引用分发表, 需比mHandle后析构
+    std::array<FunctionHandler, MAX_FUNCTION_CODE + 1> mFunctionHandlers;
+    std::unique_ptr<modbus_reply_table_t, void (*)(modbus_reply_table_t *)> mReplyTable{nullptr, modbus_reply_table_free};
     std::shared_ptr<modbus_t> mHandle;
     int mSlaveId = UNSET_SLAVE_ID;
 
-    std::shared_ptr<modbus_mapping_t> mMapping;
+    std::shared_ptr<RegisterBank> mHoldRegisters;
+    std::shared_ptr<RegisterBank> mInputRegisters;
     RegisterInfo mRegisterInfo;
 
+    struct Unit
+    {
+        std::shared_ptr<RegisterBank> holdRegisters;
+        std::shared_ptr<RegisterBank> inputRegisters;
+    };
+    // 按单元号直接索引, 分发时不需要查找
+    std::array<std::unique_ptr<Unit>, MAX_UNITS> mUnits;
+    bool mRouteUnits = false;
+
 protected:
-    bool legalAddress(int addr, AddrType type);
+    RegisterBank *bank(AddrType type) const;
+    // 按单元号找到请求对应的寄存器组, 找不到返回false
+    bool route(int unitId, RegisterBank *&hold, RegisterBank *&input) const;
+    // 处理一帧请求并回复, 可被多个线程同时调用
+    int reply(modbus_t *ctx, const uint8_t *req, int len);
+    // 在指定的寄存器组上处理请求并回复
+    int reply(modbus_t *ctx, const uint8_t *req, int len, RegisterBank *hold, RegisterBank *input);
+    // 多单元模式下的RTU广播: 每个单元各执行一次, 都不应答
+    void replyBroadcast(modbus_t *ctx, const uint8_t *req, int len);
+    static int dispatchFunction(modbus_t *ctx, const uint8_t *req, int len, uint8_t *rsp,
+                                modbus_mapping_t *mapping, void *userData);
 };
 
 class ModbusSlaveTCP : public ModbusSlave
 {
 public:
+    enum class ServerMode : uint8_t
+    {
+        THREAD_PER_CLIENT,  // 每个主站一个线程
+        REACTOR             // epoll事件循环复用所有连接
+    };
+
     ModbusSlaveTCP() = default;
 
     bool open() override;
     void setLocalPort(const std::string &ip, int port);
+    void setServerMode(ServerMode mode, int reactorThreads = 1);
+    // 使用外部共享的reactor(需已start), 大量从站共用事件循环线程
+    void setReactor(std::shared_ptr<ModbusTcpReactor> reactor);
+
+    static constexpr int DEFAULT_MAX_CLIENTS = 64;
+    static constexpr int DEFAULT_IDLE_TIMEOUT_MS = 60000;
+    // 每个主站一个线程模式下的连接限制: 同时服务maxClients个连接, 满了之后暂停accept, 新连接留在内核的监听队列中,
+    // 直到有连接断开; 连接超过idleTimeoutMs没有请求时断开, 0表示不限. 需在open之前调用
+    void setClientLimits(int maxClients, int idleTimeoutMs = DEFAULT_IDLE_TIMEOUT_MS);
 
 private:
     std::string mIp;
     int mPort;
 
-    static constexpr int LISTEN_LIST_LEN = 5;
+    // 连接数满时等待的连接排在这里
+    static constexpr int LISTEN_LIST_LEN = 128;
+    ServerMode mServerMode = ModbusTcpReactor::supported() ? ServerMode::REACTOR : ServerMode::THREAD_PER_CLIENT;
+    int mReactorThreads = 1;
+    std::shared_ptr<ModbusTcpReactor> mReactor;
+    bool mSharedReactor = false;
     std::unique_ptr<std::thread> mListenThread;
-    mutable std::mutex mMappingMutex;
-    int mSockServ = -1;
+    int mSockServ = platform::INVALID_SOCK;
 
-    bool mFinish = false;
+    // 工作线程池: 连接断开后线程不退出, 回到空闲状态等待下一个连接
+    struct Worker
+    {
+        std::unique_ptr<std::thread> thread;
+        // 正在服务的连接, 空闲时为INVALID_SOCK
+        int sock = platform::INVALID_SOCK;
+    };
+    int mMaxClients = DEFAULT_MAX_CLIENTS;
+    int mIdleTimeoutMs = DEFAULT_IDLE_TIMEOUT_MS;
+    std::mutex mPoolMutex;
+    // 空闲工作线程等待分配连接
+    std::condition_variable mWorkerCond;
+    // 监听线程等待空闲槽位
+    std::condition_variable mSlotCond;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    int mBusyWorkers = 0;
+
+    std::atomic<bool> mFinish{false};
+#if !defined(_WIN32)
+    // close时唤醒阻塞在监听套接字上的监听线程
+    platform::Wakeup mWakeup;
+#endif
 
 private:
-    void tcpListen();
+    // handle在线程启动之后才交给mHandle, 由参数传入
+    void tcpListen(modbus_t *handle);
+    void workerLoop(Worker *worker);
     void handleClient(int client);
 };
 
+// 添加了单元(addUnit)的RTU从站在同一串口上应答所有单元号, setSlave设置的地址使用createRegisterMapping的寄存器组,
+// 其他地址不应答, 与多点总线上不存在的设备一样; 广播(地址0)的写请求由每个单元各执行一次. 此时认为总线上只有本进程应答.
 class ModbusSlaveRTU : public ModbusSlave
 {
 public:
@@ -93,6 +195,14 @@ public:
     bool open() override;
     void setTarget(const std::string &com, int baud, char parity, int databits, int stopbits);
 
+#if !defined(_WIN32)
+    // 虚拟总线: 不打开setTarget指定的串口, 而是创建一对伪终端, 从站监听主端, 被测主站打开busPort()返回的从端,
+    // 不需要任何硬件. link非空时另在该路径建一个指向从端的符号链接, 便于固定主站的配置. 需在open之前调用
+    void setVirtualBus(const std::string &link = std::string());
+    // 虚拟总线的从端路径, 未打开时为空
+    const std::string &busPort() const { return mBusPort; }
+#endif
+
 private:
     std::string mCom;
     int mBaud;
@@ -100,12 +210,21 @@ private:
     int mDataBits;
     int mStopBits;
 
-    bool mFinish = false;
+    std::atomic<bool> mFinish{false};
+#if !defined(_WIN32)
+    // close时唤醒应答线程, 线程平时阻塞在串口和它上面
+    platform::Wakeup mWakeup;
+
+    bool mVirtualBus = false;
+    std::string mBusLink;
+    std::string mBusPort;
+    int mBusPeer = -1;
+#endif
 
     std::unique_ptr<std::thread> mReplyMaster;
 
 private:
-    void replyMaster();
+    void replyMaster(modbus_t *ctx);
 };
 
 #endif // MODBUSSLAVE_H
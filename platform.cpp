@@ -0,0 +1,296 @@
+#include "platform.h"
+
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <cerrno>
+#include <ctime>
+#include <cstdlib>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace platform
+{
+
+bool setNonBlocking(int sock)
+{
+#if defined(_WIN32)
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+void closeSocket(int sock)
+{
+    if (sock == INVALID_SOCK)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    closesocket(sock);
+#else
+    ::close(sock);
+#endif
+}
+
+void shutdownSocket(int sock)
+{
+    if (sock == INVALID_SOCK)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    shutdown(sock, SD_BOTH);
+#else
+    shutdown(sock, SHUT_RDWR);
+#endif
+}
+
+bool setNoDelay(int sock)
+{
+    int option = 1;
+    return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&option), sizeof(option)) == 0;
+}
+
+int waitReadable(int sock, int timeoutMs)
+{
+#if defined(_WIN32)
+    WSAPOLLFD pfd{};
+    pfd.fd = sock;
+    pfd.events = POLLRDNORM;
+    int rc = WSAPoll(&pfd, 1, timeoutMs);
+    return rc > 0 ? 1 : (rc == 0 ? 0 : -1);
+#else
+    pollfd pfd{};
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    int rc;
+    do
+    {
+        rc = poll(&pfd, 1, timeoutMs);
+    } while (rc == -1 && errno == EINTR);
+    return rc > 0 ? 1 : (rc == 0 ? 0 : -1);
+#endif
+}
+
+void sleepMs(int ms)
+{
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    timespec req{ms / 1000, (ms % 1000) * 1000000L};
+    timespec rem{};
+    while (nanosleep(&req, &rem) == -1 && errno == EINTR)
+    {
+        req = rem;
+    }
+#endif
+}
+
+#if !defined(_WIN32)
+bool openWakeup(Wakeup &wakeup)
+{
+#if defined(__linux__)
+    wakeup.readFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    wakeup.writeFd = wakeup.readFd;
+    return wakeup.readFd != -1;
+#else
+    int fds[2];
+    if (pipe(fds) == -1)
+    {
+        return false;
+    }
+    for (int fd : fds)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        setNonBlocking(fd);
+    }
+    wakeup.readFd = fds[0];
+    wakeup.writeFd = fds[1];
+    return true;
+#endif
+}
+
+void signalWakeup(const Wakeup &wakeup)
+{
+    // 只写不读, 描述符一直保持可读; 写满时说明已经触发过, 忽略失败
+#if defined(__linux__)
+    uint64_t one = 1;
+#else
+    uint8_t one = 1;
+#endif
+    if (write(wakeup.writeFd, &one, sizeof(one)) < 0)
+    {
+        return;
+    }
+}
+
+void closeWakeup(Wakeup &wakeup)
+{
+    if (wakeup.writeFd != wakeup.readFd && wakeup.writeFd != -1)
+    {
+        ::close(wakeup.writeFd);
+    }
+    if (wakeup.readFd != -1)
+    {
+        ::close(wakeup.readFd);
+    }
+    wakeup = Wakeup{};
+}
+
+int waitReadable(int fd, const Wakeup &wakeup, int timeoutMs)
+{
+    pollfd pfd[2]{};
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = wakeup.readFd;
+    pfd[1].events = POLLIN;
+    int rc;
+    do
+    {
+        rc = poll(pfd, 2, timeoutMs);
+    } while (rc == -1 && errno == EINTR);
+    if (rc <= 0 || pfd[1].revents)
+    {
+        return rc == -1 ? -1 : 0;
+    }
+    if (pfd[0].revents & POLLIN)
+    {
+        return 1;
+    }
+    return -1;
+}
+
+std::string openPseudoTerminalPeer(int masterFd, const std::string &link, int &peerFd)
+{
+    peerFd = -1;
+    if (grantpt(masterFd) == -1 || unlockpt(masterFd) == -1)
+    {
+        return std::string();
+    }
+    const char *name = ptsname(masterFd);
+    if (!name)
+    {
+        return std::string();
+    }
+    std::string path = name;
+    peerFd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (peerFd == -1)
+    {
+        return std::string();
+    }
+    if (!link.empty())
+    {
+        struct stat st = {};
+        if (lstat(link.c_str(), &st) == 0 && S_ISLNK(st.st_mode))
+        {
+            unlink(link.c_str());
+        }
+        if (symlink(path.c_str(), link.c_str()) == -1)
+        {
+            ::close(peerFd);
+            peerFd = -1;
+            return std::string();
+        }
+    }
+    return path;
+}
+
+void closePseudoTerminalPeer(int peerFd, const std::string &link)
+{
+    if (!link.empty())
+    {
+        unlink(link.c_str());
+    }
+    if (peerFd != -1)
+    {
+        ::close(peerFd);
+    }
+}
+#endif
+
+void raiseFileLimit()
+{
+#if !defined(_WIN32)
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+void *mapSharedMemory(const std::string &name, size_t size, bool &created, int mode)
+{
+#if defined(_WIN32)
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                        static_cast<DWORD>(size), name.c_str());
+    if (!mapping)
+    {
+        return nullptr;
+    }
+    created = GetLastError() != ERROR_ALREADY_EXISTS;
+    (void)mode;
+    void *addr = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    // 映射视图会持有映射对象, 句柄可以立即关闭
+    CloseHandle(mapping);
+    return addr;
+#else
+    created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, static_cast<mode_t>(mode));
+    if (fd == -1 && errno == EEXIST)
+    {
+        // 已存在时沿用创建者设置的权限
+        created = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0);
+    }
+    if (fd == -1)
+    {
+        return nullptr;
+    }
+    struct stat st = {};
+    if (fstat(fd, &st) == -1 || (static_cast<size_t>(st.st_size) < size && ftruncate(fd, size) == -1))
+    {
+        ::close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    return addr == MAP_FAILED ? nullptr : addr;
+#endif
+}
+
+void unmapSharedMemory(void *addr, size_t size)
+{
+    if (!addr)
+    {
+        return;
+    }
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(addr);
+#else
+    munmap(addr, size);
+#endif
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <cstddef>
+#include <string>
+
+// 套接字与计时相关的平台差异集中在这里, Windows使用winsock, 其他平台使用POSIX接口
+namespace platform
+{
+constexpr int INVALID_SOCK = -1;
+
+bool setNonBlocking(int sock);
+void closeSocket(int sock);
+// 关闭连接的收发两个方向, 阻塞在该套接字上的读写立即返回, 描述符仍需closeSocket释放
+void shutdownSocket(int sock);
+// 关闭Nagle算法, 应答已经在应用层合并, 不需要内核再攒包
+bool setNoDelay(int sock);
+
+// 等待套接字可读, 返回1表示可读, 0表示超时, -1表示出错; timeoutMs < 0 时一直等待
+int waitReadable(int sock, int timeoutMs);
+
+void sleepMs(int ms);
+
+#if !defined(_WIN32)
+// 停止信号: 用来唤醒阻塞在waitReadable上的线程. Linux使用eventfd, 其他平台使用自管道;
+// 触发后一直保持可读, 同一信号可以唤醒之后的每一次等待
+struct Wakeup
+{
+    int readFd = -1;
+    int writeFd = -1;
+};
+
+bool openWakeup(Wakeup &wakeup);
+void signalWakeup(const Wakeup &wakeup);
+void closeWakeup(Wakeup &wakeup);
+
+// 同时等待fd可读和停止信号: 返回1表示fd可读, 0表示收到停止信号或超时,
+// -1表示出错或fd已挂断(如串口被拔出); timeoutMs < 0 时一直等待
+int waitReadable(int fd, const Wakeup &wakeup, int timeoutMs);
+
+// 伪终端: masterFd为已打开的/dev/ptmx, 解锁并打开对应的从端, 返回从端路径(如"/dev/pts/3"), 失败返回空串.
+// 本进程一直打开着从端, 对端程序关闭串口时主端不会挂断; link非空时在该路径建立指向从端的符号链接,
+// 已存在的符号链接会被替换
+std::string openPseudoTerminalPeer(int masterFd, const std::string &link, int &peerFd);
+void closePseudoTerminalPeer(int peerFd, const std::string &link);
+#endif
+
+// 把进程可打开的文件描述符数提高到系统允许的上限, 用于同时监听大量端口
+void raiseFileLimit();
+
+// 新建共享内存的默认权限: 只有本用户的进程可以映射
+constexpr int SHARED_MEMORY_MODE = 0600;
+
+// 打开或创建一段具名共享内存并映射到本进程, 新创建的内容全为0, created返回是否为本次创建.
+// name形如"/plant1", mode为新建时的权限位(仍受umask限制, Windows忽略), 失败返回nullptr
+void *mapSharedMemory(const std::string &name, size_t size, bool &created, int mode = SHARED_MEMORY_MODE);
+void unmapSharedMemory(void *addr, size_t size);
+}
+
+#endif // PLATFORM_H
@@ -0,0 +1,127 @@
+#include "pollplan.h"
+
+#include <algorithm>
+
+namespace
+{
+constexpr unsigned int ADDRESS_SPACE = 0x10000;
+}
+
+PollPlan::PollPlan(unsigned int gapTolerance, unsigned int maxBlock)
+    : mGapTolerance(gapTolerance)
+    , mMaxBlock(std::min<unsigned int>(std::max<unsigned int>(maxBlock, 1), MODBUS_MAX_READ_REGISTERS))
+{
+}
+
+int PollPlan::addTag(const Tag &tag)
+{
+    if ((tag.function != MODBUS_FC_READ_HOLDING_REGISTERS && tag.function != MODBUS_FC_READ_INPUT_REGISTERS)
+        || tag.len == 0 || tag.addr >= ADDRESS_SPACE || tag.len > ADDRESS_SPACE - tag.addr)
+    {
+        return -1;
+    }
+    mTags.push_back(tag);
+    mCompiled = false;
+    return static_cast<int>(mTags.size()) - 1;
+}
+
+void PollPlan::clear()
+{
+    mTags.clear();
+    mPieces.clear();
+    mRequests.clear();
+    mCompiled = false;
+}
+
+void PollPlan::compile()
+{
+    mRequests.clear();
+    mPieces.assign(mTags.size(), {});
+
+    // 超过单次上限的点位先切成若干段, 每段单独参与合并
+    struct Segment
+    {
+        size_t tag;
+        unsigned int tagOffset;
+        unsigned int addr;
+        unsigned int len;
+    };
+    std::vector<Segment> segments;
+    for (size_t i = 0; i < mTags.size(); i++)
+    {
+        const Tag &tag = mTags[i];
+        for (unsigned int off = 0; off < tag.len; off += mMaxBlock)
+        {
+            segments.push_back({i, off, tag.addr + off, std::min(mMaxBlock, tag.len - off)});
+        }
+    }
+    std::sort(segments.begin(), segments.end(), [this](const Segment &a, const Segment &b)
+              {
+                  int fa = mTags[a.tag].function;
+                  int fb = mTags[b.tag].function;
+                  return fa != fb ? fa < fb : a.addr < b.addr;
+              });
+
+    // 贪心合并: 与当前块同功能码, 空洞不超过容差且合并后不超过上限时并入当前块
+    size_t i = 0;
+    while (i < segments.size())
+    {
+        int function = mTags[segments[i].tag].function;
+        unsigned int start = segments[i].addr;
+        unsigned int end = start + segments[i].len;
+        size_t j = i + 1;
+        while (j < segments.size() && mTags[segments[j].tag].function == function
+               && segments[j].addr <= end + mGapTolerance
+               && std::max(end, segments[j].addr + segments[j].len) - start <= mMaxBlock)
+        {
+            end = std::max(end, segments[j].addr + segments[j].len);
+            j++;
+        }
+
+        size_t request = mRequests.size();
+        mRequests.push_back({function, start, end - start});
+        for (; i < j; i++)
+        {
+            const Segment &seg = segments[i];
+            mPieces[seg.tag].push_back({request, seg.addr - start, seg.tagOffset, seg.len});
+        }
+    }
+    mCompiled = true;
+}
+
+std::vector<std::vector<uint16_t>> PollPlan::scatter(const std::vector<std::vector<uint16_t>> &responses) const
+{
+    std::vector<std::vector<uint16_t>> values(mTags.size());
+    for (size_t t = 0; t < mPieces.size(); t++)
+    {
+        bool ok = true;
+        for (const Piece &piece : mPieces[t])
+        {
+            if (piece.request >= responses.size() || responses[piece.request].size() < piece.offset + piece.len)
+            {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok)
+        {
+            continue;
+        }
+        values[t].resize(mTags[t].len);
+        for (const Piece &piece : mPieces[t])
+        {
+            const uint16_t *src = responses[piece.request].data() + piece.offset;
+            std::copy(src, src + piece.len, values[t].begin() + piece.tagOffset);
+        }
+    }
+    return values;
+}
+
+std::vector<std::vector<uint16_t>> PollPlan::scan(ModbusMaster &master)
+{
+    if (!mCompiled)
+    {
+        compile();
+    }
+    return scatter(master.readRegisters(mRequests));
+}
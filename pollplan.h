@@ -0,0 +1,58 @@
+#ifndef POLLPLAN_H
+#define POLLPLAN_H
+
+#include <vector>
+
+#include "modbusmaster.h"
+
+// 轮询计划: 把大量零散的点位(功能码, 地址, 长度)合并成尽量少的读请求,
+// 相邻或间隔不超过容差的区间合并为一次读取, 单次不超过125个寄存器.
+// 扫描时按计划发出请求, 再把结果拆回到各个点位.
+class PollPlan
+{
+public:
+    struct Tag
+    {
+        int function = MODBUS_FC_READ_HOLDING_REGISTERS;
+        unsigned int addr = 0;
+        unsigned int len = 1;
+    };
+
+    // gapTolerance: 两个区间之间允许顺带读取的最大空洞寄存器数
+    explicit PollPlan(unsigned int gapTolerance = 0, unsigned int maxBlock = MODBUS_MAX_READ_REGISTERS);
+
+    // 返回点位序号, 结果按该序号取; 非法点位返回-1
+    int addTag(const Tag &tag);
+    void clear();
+
+    // 点位变化后重新生成请求列表, scan会在需要时自动调用
+    void compile();
+
+    const std::vector<ModbusMaster::ReadRequest> &requests() const { return mRequests; }
+    size_t transactionCount() const { return mRequests.size(); }
+
+    // responses与requests()一一对应; 某个点位涉及的请求失败时该点位结果为空
+    std::vector<std::vector<uint16_t>> scatter(const std::vector<std::vector<uint16_t>> &responses) const;
+
+    // 执行一轮扫描, 返回每个点位的值
+    std::vector<std::vector<uint16_t>> scan(ModbusMaster &master);
+
+private:
+    // 点位中的一段在某个请求结果中的位置
+    struct Piece
+    {
+        size_t request;
+        unsigned int offset;
+        unsigned int tagOffset;
+        unsigned int len;
+    };
+
+    unsigned int mGapTolerance;
+    unsigned int mMaxBlock;
+    bool mCompiled = false;
+    std::vector<Tag> mTags;
+    std::vector<std::vector<Piece>> mPieces;
+    std::vector<ModbusMaster::ReadRequest> mRequests;
+};
+
+#endif // POLLPLAN_H
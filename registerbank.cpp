@@ -0,0 +1,410 @@
+#include "registerbank.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include "platform.h"
+
+namespace
+{
+// 读者自旋这么多次仍遇到写者时让出CPU
+constexpr int SPIN_LIMIT = 64;
+}
+
+RegisterBank::RegisterBank(int start, int size)
+{
+    if (size > 0)
+    {
+        addWindow(start, size);
+    }
+}
+
+RegisterBank::~RegisterBank()
+{
+    if (mShared)
+    {
+        platform::unmapSharedMemory(mShared, SHARED_SIZE);
+        return;
+    }
+    for (auto &page : mPages)
+    {
+        delete page.load(std::memory_order_relaxed);
+    }
+}
+
+bool RegisterBank::openShared(const std::string &name, int mode)
+{
+    // 共享内存布局对外公开, 不能随编译器变化
+    static_assert(sizeof(std::atomic<uint64_t>) == 8 && std::atomic<uint64_t>::is_always_lock_free,
+                  "mapped must be a plain 64-bit word");
+    static_assert(sizeof(std::atomic<uint32_t>) == 4 && std::atomic<uint32_t>::is_always_lock_free,
+                  "seq must be a plain 32-bit word");
+    static_assert(sizeof(Page) == 552, "page layout changed");
+    static_assert(offsetof(SharedLayout, pages) == 16, "header layout changed");
+    static_assert(sizeof(SharedLayout) == SHARED_SIZE, "shared layout changed");
+
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    if (mShared)
+    {
+        return false;
+    }
+    bool created = false;
+    auto *shared = static_cast<SharedLayout *>(platform::mapSharedMemory(name, SHARED_SIZE, created, mode));
+    if (!shared)
+    {
+        return false;
+    }
+
+    SharedHeader &header = shared->header;
+    // 外部进程只创建了共享内存还没有写入头部时也按新建处理
+    const bool fresh = created || header.magic == 0;
+    if (fresh)
+    {
+        for (Page &page : shared->pages)
+        {
+            new (&page) Page();
+        }
+        header.version = SHARED_VERSION;
+        header.pageSize = PAGE_SIZE;
+        header.pageCount = PAGE_COUNT;
+        header.magic = SHARED_MAGIC;
+    }
+    else if (header.magic != SHARED_MAGIC || header.version != SHARED_VERSION || header.pageSize != PAGE_SIZE ||
+             header.pageCount != PAGE_COUNT)
+    {
+        platform::unmapSharedMemory(shared, SHARED_SIZE);
+        return false;
+    }
+
+    for (int p = 0; p < PAGE_COUNT; p++)
+    {
+        Page &page = shared->pages[p];
+        Page *old = mPages[p].load(std::memory_order_relaxed);
+        if (old)
+        {
+            if (fresh)
+            {
+                memcpy(page.data, old->data, sizeof(page.data));
+            }
+            for (int w = 0; w < PAGE_SIZE / 64; w++)
+            {
+                page.mapped[w].fetch_or(old->mapped[w].load(std::memory_order_relaxed), std::memory_order_release);
+            }
+            delete old;
+        }
+        mPages[p].store(&page, std::memory_order_release);
+    }
+    mShared = shared;
+    return true;
+}
+
+bool RegisterBank::addWindow(int start, int size)
+{
+    if (start < 0 || size <= 0 || start + size > ADDRESS_SPACE)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    for (int addr = start; addr < start + size;)
+    {
+        const int p = addr / PAGE_SIZE;
+        const int end = std::min(start + size, (p + 1) * PAGE_SIZE);
+        Page *page = mPages[p].load(std::memory_order_relaxed);
+        if (!page)
+        {
+            page = new Page();
+            mPages[p].store(page, std::memory_order_release);
+        }
+        for (int r = addr - p * PAGE_SIZE; r < end - p * PAGE_SIZE; r++)
+        {
+            page->mapped[r / 64].fetch_or(uint64_t(1) << (r % 64), std::memory_order_release);
+        }
+        addr = end;
+    }
+    return true;
+}
+
+bool RegisterBank::contains(int addr, int len) const
+{
+    if (len <= 0 || addr < 0 || addr + len > ADDRESS_SPACE)
+    {
+        return false;
+    }
+    for (int a = addr; a < addr + len;)
+    {
+        const int p = a / PAGE_SIZE;
+        const int end = std::min(addr + len, (p + 1) * PAGE_SIZE);
+        const Page *page = mPages[p].load(std::memory_order_acquire);
+        if (!page)
+        {
+            return false;
+        }
+        // 按64位一组检查映射位
+        for (int r = a - p * PAGE_SIZE; r < end - p * PAGE_SIZE;)
+        {
+            const int word = r / 64;
+            const int hi = std::min(end - p * PAGE_SIZE, (word + 1) * 64);
+            const int bits = hi - r;
+            const uint64_t want = (bits == 64 ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1)) << (r % 64);
+            if ((page->mapped[word].load(std::memory_order_acquire) & want) != want)
+            {
+                return false;
+            }
+            r = hi;
+        }
+        a = end;
+    }
+    return true;
+}
+
+bool RegisterBank::read(int addr, int len, uint16_t *dest) const
+{
+    if (!contains(addr, len))
+    {
+        return false;
+    }
+    const int first = addr / PAGE_SIZE;
+    const int last = (addr + len - 1) / PAGE_SIZE;
+
+    uint32_t seq[PAGE_COUNT];
+    for (int spin = 0;; spin++)
+    {
+        if (spin >= SPIN_LIMIT)
+        {
+            std::this_thread::yield();
+        }
+
+        bool writing = false;
+        for (int p = first; p <= last; p++)
+        {
+            seq[p - first] = mPages[p].load(std::memory_order_relaxed)->seq.load(std::memory_order_acquire);
+            writing |= (seq[p - first] & 1) != 0;
+        }
+        if (writing)
+        {
+            continue;
+        }
+
+        for (int a = addr; a < addr + len;)
+        {
+            const int p = a / PAGE_SIZE;
+            const int end = std::min(addr + len, (p + 1) * PAGE_SIZE);
+            memcpy(dest + (a - addr), mPages[p].load(std::memory_order_relaxed)->data + (a - p * PAGE_SIZE),
+                   (end - a) * sizeof(uint16_t));
+            a = end;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        bool stable = true;
+        for (int p = first; p <= last && stable; p++)
+        {
+            stable = mPages[p].load(std::memory_order_relaxed)->seq.load(std::memory_order_relaxed) == seq[p - first];
+        }
+        if (stable)
+        {
+            return true;
+        }
+    }
+}
+
+std::vector<uint16_t> RegisterBank::read(int addr, int len) const
+{
+    std::vector<uint16_t> values(len > 0 ? len : 0);
+    if (!read(addr, len, values.data()))
+    {
+        return {};
+    }
+    return values;
+}
+
+int RegisterBank::readChanged(int addr, int len, uint16_t *dest, std::vector<uint32_t> &versions) const
+{
+    if (!contains(addr, len))
+    {
+        return -1;
+    }
+    const int first = addr / PAGE_SIZE;
+    const int last = (addr + len - 1) / PAGE_SIZE;
+    if (versions.size() != static_cast<size_t>(last - first + 1))
+    {
+        // 稳定的序号总是偶数, 用奇数表示从未读取过
+        versions.assign(last - first + 1, 1);
+    }
+
+    int refreshed = 0;
+    for (int p = first; p <= last; p++)
+    {
+        // 先取序号再读数据, 期间有写入时下次会再读一遍, 不会漏掉变化
+        uint32_t seq = mPages[p].load(std::memory_order_relaxed)->seq.load(std::memory_order_acquire);
+        if (seq == versions[p - first])
+        {
+            continue;
+        }
+        const int begin = std::max(addr, p * PAGE_SIZE);
+        const int end = std::min(addr + len, (p + 1) * PAGE_SIZE);
+        read(begin, end - begin, dest + (begin - addr));
+        versions[p - first] = seq;
+        refreshed += end - begin;
+    }
+    return refreshed;
+}
+
+bool RegisterBank::write(int addr, const uint16_t *values, int len)
+{
+    if (!contains(addr, len))
+    {
+        return false;
+    }
+    const int first = addr / PAGE_SIZE;
+    const int last = (addr + len - 1) / PAGE_SIZE;
+
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    for (int p = first; p <= last; p++)
+    {
+        lockPage(p);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    copyIn(addr, values, len);
+
+    for (int p = first; p <= last; p++)
+    {
+        unlockPage(p);
+    }
+    return true;
+}
+
+bool RegisterBank::write(int addr, const std::vector<uint16_t> &values)
+{
+    return write(addr, values.data(), static_cast<int>(values.size()));
+}
+
+bool RegisterBank::update(int addr, int len, const std::function<void(uint16_t *values)> &modify)
+{
+    if (!contains(addr, len))
+    {
+        return false;
+    }
+    const int first = addr / PAGE_SIZE;
+    const int last = (addr + len - 1) / PAGE_SIZE;
+    thread_local std::vector<uint16_t> values;
+    values.resize(len);
+
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    for (int p = first; p <= last; p++)
+    {
+        lockPage(p);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    copyOut(addr, values.data(), len);
+    modify(values.data());
+    copyIn(addr, values.data(), len);
+
+    for (int p = first; p <= last; p++)
+    {
+        unlockPage(p);
+    }
+    return true;
+}
+
+bool RegisterBank::write(const std::vector<Run> &runs, const uint16_t *values)
+{
+    int prevEnd = 0;
+    for (const Run &run : runs)
+    {
+        if (run.addr < prevEnd || !contains(run.addr, run.len))
+        {
+            return false;
+        }
+        prevEnd = run.addr + run.len;
+    }
+    if (runs.empty())
+    {
+        return true;
+    }
+
+    // 各段地址递增, 依次加锁即可保证页号从小到大, 相邻段落在同一页时只锁一次
+    std::lock_guard<std::mutex> lock(mWriteMutex);
+    int locked = -1;
+    for (const Run &run : runs)
+    {
+        for (int p = std::max(locked + 1, run.addr / PAGE_SIZE); p <= (run.addr + run.len - 1) / PAGE_SIZE; p++)
+        {
+            lockPage(p);
+            locked = p;
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (const Run &run : runs)
+    {
+        copyIn(run.addr, values, run.len);
+        values += run.len;
+    }
+
+    locked = -1;
+    for (const Run &run : runs)
+    {
+        for (int p = std::max(locked + 1, run.addr / PAGE_SIZE); p <= (run.addr + run.len - 1) / PAGE_SIZE; p++)
+        {
+            unlockPage(p);
+            locked = p;
+        }
+    }
+    return true;
+}
+
+void RegisterBank::copyIn(int addr, const uint16_t *values, int len)
+{
+    for (int a = addr; a < addr + len;)
+    {
+        const int p = a / PAGE_SIZE;
+        const int end = std::min(addr + len, (p + 1) * PAGE_SIZE);
+        memcpy(mPages[p].load(std::memory_order_relaxed)->data + (a - p * PAGE_SIZE), values + (a - addr),
+               (end - a) * sizeof(uint16_t));
+        a = end;
+    }
+}
+
+void RegisterBank::copyOut(int addr, uint16_t *values, int len) const
+{
+    for (int a = addr; a < addr + len;)
+    {
+        const int p = a / PAGE_SIZE;
+        const int end = std::min(addr + len, (p + 1) * PAGE_SIZE);
+        memcpy(values + (a - addr), mPages[p].load(std::memory_order_relaxed)->data + (a - p * PAGE_SIZE),
+               (end - a) * sizeof(uint16_t));
+        a = end;
+    }
+}
+
+void RegisterBank::lockPage(int p)
+{
+    // 序号变为奇数, 读者看到后等待写入完成. 共享内存中可能还有其他进程的写者,
+    // 用CAS抢占, 并且总是按页号从小到大加锁, 多个写者之间不会互相等待成环
+    std::atomic<uint32_t> &seq = mPages[p].load(std::memory_order_relaxed)->seq;
+    uint32_t cur = seq.load(std::memory_order_relaxed);
+    for (int spin = 0;; spin++)
+    {
+        if ((cur & 1) == 0 && seq.compare_exchange_weak(cur, cur + 1, std::memory_order_acquire))
+        {
+            return;
+        }
+        if (spin >= SPIN_LIMIT)
+        {
+            std::this_thread::yield();
+        }
+        cur = seq.load(std::memory_order_relaxed);
+    }
+}
+
+void RegisterBank::unlockPage(int p)
+{
+    std::atomic<uint32_t> &seq = mPages[p].load(std::memory_order_relaxed)->seq;
+    seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
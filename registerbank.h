@@ -0,0 +1,120 @@
+#ifndef REGISTERBANK_H
+#define REGISTERBANK_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "platform.h"
+
+// 覆盖0~65535完整地址空间的16位寄存器组, 按PAGE_SIZE分页, 页在第一次映射时才分配,
+// 内存只与实际映射的寄存器数有关; 可以映射任意多个不连续的地址窗口, 未映射的地址读写都失败.
+// 每页一个seqlock序号: 读者不加锁, 遇到并发写入时重试, 保证读到的多寄存器值(如32位浮点)不会被撕裂;
+// 写者先把页序号从偶数CAS成奇数占住该页, 写完再加1; 一次write()覆盖的所有寄存器对读者来说是原子的.
+//
+// 寄存器组可以放在具名共享内存中(openShared), 其他进程映射同一段内存后直接读写寄存器,
+// 不经过Modbus也不经过本进程. 布局(本机字节序, 自然对齐, 共 SHARED_SIZE 字节):
+//   偏移0   SharedHeader: uint32 magic = SHARED_MAGIC, uint32 version = 1,
+//                         uint32 pageSize = 256, uint32 pageCount = 256
+//   偏移16  Page[256], 每页552字节, 第p页覆盖地址[p * 256, p * 256 + 256):
+//             +0    uint16 data[256]     寄存器值
+//             +512  uint64 mapped[4]     每个寄存器一位, 置位表示已映射(外部进程也可以置位来增加窗口)
+//             +544  uint32 seq           seqlock序号, 奇数表示有写者正在写
+//             +548  uint32 reserved
+// 外部写者的协议与本进程相同: 对涉及的每一页按页号从小到大把seq从偶数CAS为奇数(失败则重试),
+// 写data, 再以release语义把seq加1. 外部读者读seq(偶数) -> 拷贝data -> 再读seq, 两次相同即为一致的值.
+class RegisterBank
+{
+public:
+    static constexpr int PAGE_SIZE = 256;
+    static constexpr int ADDRESS_SPACE = 65536;
+    static constexpr int PAGE_COUNT = ADDRESS_SPACE / PAGE_SIZE;
+    static constexpr uint32_t SHARED_MAGIC = 0x4252424D; // "MBRB"
+    static constexpr uint32_t SHARED_VERSION = 1;
+    static constexpr size_t SHARED_SIZE = 16 + PAGE_COUNT * 552;
+
+    RegisterBank() = default;
+    // 映射一个窗口[start, start + size)
+    RegisterBank(int start, int size);
+    ~RegisterBank();
+
+    RegisterBank(const RegisterBank &) = delete;
+    RegisterBank &operator=(const RegisterBank &) = delete;
+
+    // 增加映射窗口, 可以在运行中调用; 与已有窗口重叠的部分保持原值
+    bool addWindow(int start, int size);
+    // 改用具名共享内存存储, 需在寄存器组投入使用之前调用. 共享内存已存在时沿用其中的值和窗口,
+    // 再加上本寄存器组已有的窗口; 新建时把已有的值拷贝进去. 共享内存在进程退出后保留, 由使用方删除.
+    // mode为新建时的权限, 其他用户的进程需要访问时才放宽
+    bool openShared(const std::string &name, int mode = platform::SHARED_MEMORY_MODE);
+    bool isShared() const { return mShared != nullptr; }
+
+    // [addr, addr + len)内的寄存器是否全部已映射
+    bool contains(int addr, int len = 1) const;
+
+    bool read(int addr, int len, uint16_t *dest) const;
+    std::vector<uint16_t> read(int addr, int len) const;
+
+    // 只重新读取上次之后被写过的页. versions由调用方保存, 每页记录一次读取时的序号,
+    // 范围变化后传入空数组即可全部重读; dest按addr对齐, 未变化的部分保持原值.
+    // 返回重新读取的寄存器数, 范围非法返回-1
+    int readChanged(int addr, int len, uint16_t *dest, std::vector<uint32_t> &versions) const;
+
+    bool write(int addr, const uint16_t *values, int len);
+    bool write(int addr, const std::vector<uint16_t> &values);
+
+    // 读-改-写: 占住涉及的页, 把[addr, addr + len)的当前值交给modify就地修改后写回, 期间其他写者
+    // (包括共享内存中的外部写者)不能插入, 读者要么看到修改前的值要么看到修改后的值.
+    // modify中不能再访问本寄存器组, 否则会等待自己占住的页
+    bool update(int addr, int len, const std::function<void(uint16_t *values)> &modify);
+
+    struct Run
+    {
+        int addr;
+        int len;
+    };
+    // 一次写入多段不连续的寄存器, runs按地址递增且互不重叠, values按段依次排列;
+    // 所有段对读者来说同时生效, 任何一段未映射时什么也不写
+    bool write(const std::vector<Run> &runs, const uint16_t *values);
+
+private:
+    struct Page
+    {
+        uint16_t data[PAGE_SIZE] = {};
+        // 每个寄存器一位, 表示是否已映射
+        std::atomic<uint64_t> mapped[PAGE_SIZE / 64] = {};
+        std::atomic<uint32_t> seq{0};
+        uint32_t reserved = 0;
+    };
+
+    struct SharedHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t pageSize;
+        uint32_t pageCount;
+    };
+
+    struct SharedLayout
+    {
+        SharedHeader header;
+        Page pages[PAGE_COUNT];
+    };
+
+    // 页表, 未映射的页为空; 共享模式下所有页都指向共享内存
+    std::atomic<Page *> mPages[PAGE_COUNT] = {};
+    SharedLayout *mShared = nullptr;
+    std::mutex mWriteMutex;
+
+private:
+    void lockPage(int p);
+    void unlockPage(int p);
+    void copyIn(int addr, const uint16_t *values, int len);
+    void copyOut(int addr, uint16_t *values, int len) const;
+};
+
+#endif // REGISTERBANK_H
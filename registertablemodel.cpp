@@ -0,0 +1,147 @@
+#include "registertablemodel.h"
+
+#include <algorithm>
+
+RegisterTableModel::RegisterTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void RegisterTableModel::setAddrAndCount(int addr, int count){
+    addr = std::clamp(addr, 0, ADDRESS_SPACE - 1);
+    count = std::clamp(count, 0, ADDRESS_SPACE - addr);
+
+    beginResetModel();
+    mAddr = addr;
+    mCount = count;
+    mBase = (addr / COLUMNS) * COLUMNS;
+    mValues.assign(count, 0);
+    for(auto &text : mText){
+        text.assign(count, QString());
+    }
+    mEditable = true;
+    endResetModel();
+}
+
+void RegisterTableModel::setValues(int addr, const std::vector<uint16_t> &values){
+    // 只保留落在当前范围内的部分
+    int first = std::max(addr, mAddr);
+    int last = std::min<int>(addr + values.size(), mAddr + mCount);
+    if(first >= last){
+        return;
+    }
+
+    // 比较新旧值, 连续的变化行合并成一次通知
+    int runFirst = -1;
+    int runLast = -1;
+    for(int a = first; a < last; a++){
+        uint16_t val = values[a - addr];
+        uint16_t &cur = mValues[a - mAddr];
+        if(cur == val){
+            continue;
+        }
+        cur = val;
+        for(auto &text : mText){
+            text[a - mAddr] = QString();
+        }
+        int row = (a - mBase) / COLUMNS;
+        if(runFirst >= 0 && row > runLast + 1){
+            emit dataChanged(index(runFirst, 0), index(runLast, COLUMNS - 1), {Qt::DisplayRole});
+            runFirst = -1;
+        }
+        if(runFirst < 0){
+            runFirst = row;
+        }
+        runLast = row;
+    }
+    if(runFirst >= 0){
+        emit dataChanged(index(runFirst, 0), index(runLast, COLUMNS - 1), {Qt::DisplayRole});
+    }
+}
+
+void RegisterTableModel::setDisplayMode(DisplayMode mode){
+    if(mDisplayMode == mode){
+        return;
+    }
+    mDisplayMode = mode;
+    int rows = rowCount();
+    if(rows > 0){
+        emit dataChanged(index(0, 0), index(rows - 1, COLUMNS - 1), {Qt::DisplayRole});
+        emit headerDataChanged(Qt::Vertical, 0, rows - 1);
+    }
+    emit headerDataChanged(Qt::Horizontal, 0, COLUMNS - 1);
+}
+
+void RegisterTableModel::setEditable(bool editable){
+    if(mEditable == editable){
+        return;
+    }
+    mEditable = editable;
+    int rows = rowCount();
+    if(rows > 0){
+        emit dataChanged(index(0, 0), index(rows - 1, COLUMNS - 1));
+    }
+}
+
+int RegisterTableModel::address(const QModelIndex &index) const{
+    if(!index.isValid()){
+        return -1;
+    }
+    int addr = mBase + index.row() * COLUMNS + index.column();
+    if(addr < mAddr || addr >= mAddr + mCount){
+        return -1;
+    }
+    return addr;
+}
+
+int RegisterTableModel::rowCount(const QModelIndex &parent) const{
+    if(parent.isValid() || mCount == 0){
+        return 0;
+    }
+    return (mAddr + mCount - 1 - mBase) / COLUMNS + 1;
+}
+
+int RegisterTableModel::columnCount(const QModelIndex &parent) const{
+    return parent.isValid() ? 0 : COLUMNS;
+}
+
+QVariant RegisterTableModel::data(const QModelIndex &index, int role) const{
+    if(role == Qt::TextAlignmentRole){
+        return int(Qt::AlignCenter);
+    }
+    if(role != Qt::DisplayRole){
+        return {};
+    }
+    int addr = address(index);
+    if(addr < 0){
+        return {};
+    }
+    QString &text = mText[static_cast<int>(mDisplayMode)][addr - mAddr];
+    if(text.isNull()){
+        uint16_t val = mValues[addr - mAddr];
+        if(mDisplayMode == DisplayMode::HEX){
+            text = QString::asprintf("%04X", val);
+        }else{
+            text = QString::number(val);
+        }
+    }
+    return text;
+}
+
+QVariant RegisterTableModel::headerData(int section, Qt::Orientation orientation, int role) const{
+    if(role != Qt::DisplayRole){
+        return {};
+    }
+    int base = mDisplayMode == DisplayMode::HEX ? 16 : 10;
+    if(orientation == Qt::Horizontal){
+        return QString::number(section, base);
+    }
+    return QString::number(mBase + section * COLUMNS, base);
+}
+
+Qt::ItemFlags RegisterTableModel::flags(const QModelIndex &index) const{
+    if(!mEditable || address(index) < 0){
+        return Qt::NoItemFlags;
+    }
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
@@ -0,0 +1,52 @@
+#ifndef REGISTERTABLEMODEL_H
+#define REGISTERTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <cstdint>
+#include <vector>
+
+// 寄存器表格模型: 每行10个寄存器, 行表头为该行起始地址, 列表头为偏移.
+// 单元格内容在视图请求时才生成, 不为每个寄存器创建控件,
+// 内存和绘制开销只与可见区域有关, 可以覆盖完整的65536地址空间.
+class RegisterTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum class DisplayMode{
+        DEC,
+        HEX
+    };
+
+    static constexpr int COLUMNS = 10;
+    static constexpr int ADDRESS_SPACE = 0x10000;
+
+    explicit RegisterTableModel(QObject *parent = nullptr);
+
+    void setAddrAndCount(int addr, int count);
+    // 只有值真正变化的单元格会通知视图重绘
+    void setValues(int addr, const std::vector<uint16_t> &values);
+    void setDisplayMode(DisplayMode mode);
+    void setEditable(bool editable);
+
+    // 单元格对应的寄存器地址, 不在范围内返回-1
+    int address(const QModelIndex &index) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
+private:
+    int mAddr = 0;
+    int mCount = 0;
+    // 第一行的起始地址, 按10对齐
+    int mBase = 0;
+    std::vector<uint16_t> mValues;
+    // 每种显示模式各缓存一份格式化后的文本, 空字符串表示需要重新生成; 值变化时两份一起作废
+    mutable std::vector<QString> mText[2];
+    DisplayMode mDisplayMode = DisplayMode::DEC;
+    bool mEditable = true;
+};
+
+#endif // REGISTERTABLEMODEL_H
@@ -0,0 +1,345 @@
+#include "signalengine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+constexpr double TWO_PI = 6.283185307179586;
+
+int width(SignalEngine::Format format)
+{
+    return format == SignalEngine::Format::FLOAT32 ? 2 : 1;
+}
+
+// xorshift32, 返回[-1, 1)内的均匀分布
+inline double uniform(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<int32_t>(state) * (1.0 / 2147483648.0);
+}
+
+inline void encode(double value, SignalEngine::Format format, uint16_t *dest)
+{
+    switch (format)
+    {
+    case SignalEngine::Format::UINT16:
+        dest[0] = static_cast<uint16_t>(std::clamp(std::lround(value), 0L, 65535L));
+        break;
+    case SignalEngine::Format::INT16:
+        dest[0] = static_cast<uint16_t>(static_cast<int16_t>(std::clamp(std::lround(value), -32768L, 32767L)));
+        break;
+    case SignalEngine::Format::FLOAT32:
+    {
+        float f = static_cast<float>(value);
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        dest[0] = static_cast<uint16_t>(bits >> 16);
+        dest[1] = static_cast<uint16_t>(bits);
+        break;
+    }
+    }
+}
+}
+
+SignalEngine::SignalEngine(int rateHz)
+    : mRateHz(rateHz > 0 ? rateHz : DEFAULT_RATE_HZ)
+{
+}
+
+SignalEngine::~SignalEngine()
+{
+    stop();
+}
+
+int SignalEngine::addSignal(const std::shared_ptr<RegisterBank> &bank, const Signal &signal)
+{
+    if (mThread || !bank || !bank->contains(signal.addr, width(signal.format)))
+    {
+        return -1;
+    }
+    switch (signal.waveform)
+    {
+    case Waveform::SINE:
+    case Waveform::RAMP:
+    case Waveform::SQUARE:
+        if (!(signal.periodMs > 0))
+        {
+            return -1;
+        }
+        break;
+    case Waveform::REPLAY:
+        if (signal.samples.empty())
+        {
+            return -1;
+        }
+        break;
+    default:
+        break;
+    }
+    mSignals.push_back({bank, signal});
+    return static_cast<int>(mSignals.size()) - 1;
+}
+
+bool SignalEngine::loadCsv(const std::string &path, int column, std::vector<double> &samples)
+{
+    std::ifstream file(path);
+    if (!file || column < 0)
+    {
+        return false;
+    }
+    samples.clear();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string field;
+        bool found = false;
+        for (int i = 0; !found && std::getline(fields, field, ','); i++)
+        {
+            found = i == column;
+        }
+        if (!found)
+        {
+            continue;
+        }
+        char *end = nullptr;
+        double value = strtod(field.c_str(), &end);
+        if (end != field.c_str())
+        {
+            samples.push_back(value);
+        }
+    }
+    return !samples.empty();
+}
+
+bool SignalEngine::start()
+{
+    if (mThread)
+    {
+        return true;
+    }
+    if (!compile())
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = false;
+    }
+    mThread = std::make_unique<std::thread>(&SignalEngine::run, this);
+    return true;
+}
+
+void SignalEngine::stop()
+{
+    if (!mThread)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFinish = true;
+    }
+    mCond.notify_one();
+    mThread->join();
+    mThread.reset();
+}
+
+bool SignalEngine::compile()
+{
+    // 按(寄存器组, 地址)排序, 相邻的寄存器合并成一段
+    std::vector<size_t> order(mSignals.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+              {
+                  const Binding &x = mSignals[a];
+                  const Binding &y = mSignals[b];
+                  return x.bank != y.bank ? std::less<RegisterBank *>()(x.bank.get(), y.bank.get())
+                                          : x.signal.addr < y.signal.addr;
+              });
+
+    mOutputs.clear();
+    std::vector<std::pair<size_t, int>> offsets(mSignals.size());
+    for (size_t i : order)
+    {
+        const Binding &binding = mSignals[i];
+        const int len = width(binding.signal.format);
+        if (mOutputs.empty() || mOutputs.back().bank != binding.bank)
+        {
+            mOutputs.push_back({binding.bank, {}, {}});
+        }
+        Output &out = mOutputs.back();
+        RegisterBank::Run *last = out.runs.empty() ? nullptr : &out.runs.back();
+        if (last && binding.signal.addr < last->addr + last->len)
+        {
+            mOutputs.clear();
+            return false;
+        }
+        if (last && binding.signal.addr == last->addr + last->len)
+        {
+            last->len += len;
+        }
+        else
+        {
+            out.runs.push_back({binding.signal.addr, len});
+        }
+        offsets[i] = {mOutputs.size() - 1, static_cast<int>(out.buffer.size())};
+        out.buffer.resize(out.buffer.size() + len);
+    }
+
+    // 缓冲区大小已确定, 之后可以直接保存指针
+    mColumns.clear();
+    for (size_t i = 0; i < mSignals.size(); i++)
+    {
+        const Signal &signal = mSignals[i].signal;
+        auto column = std::find_if(mColumns.begin(), mColumns.end(), [&signal](const Column &c)
+                                   { return c.waveform == signal.waveform; });
+        if (column == mColumns.end())
+        {
+            mColumns.push_back(Column{});
+            column = mColumns.end() - 1;
+            column->waveform = signal.waveform;
+        }
+        column->offset.push_back(signal.offset);
+        column->amplitude.push_back(signal.amplitude);
+        column->step.push_back(signal.step);
+        column->increment.push_back(signal.periodMs > 0 ? 1000.0 / (signal.periodMs * mRateHz) : 0);
+        column->phase.push_back(signal.phase);
+        column->state.push_back(signal.offset);
+        // xorshift的种子不能为0
+        column->random.push_back(static_cast<uint32_t>(2463534242u + i * 2654435761u) | 1u);
+        column->values.push_back(0);
+        column->samples.push_back(&signal.samples);
+        column->cursor.push_back(0);
+        column->target.push_back(mOutputs[offsets[i].first].buffer.data() + offsets[i].second);
+        column->format.push_back(signal.format);
+    }
+    return true;
+}
+
+void SignalEngine::evaluate(uint64_t tick)
+{
+    const double t = static_cast<double>(tick);
+    for (Column &c : mColumns)
+    {
+        const size_t n = c.values.size();
+        double *values = c.values.data();
+        const double *offset = c.offset.data();
+        const double *amplitude = c.amplitude.data();
+        const double *increment = c.increment.data();
+        const double *phase = c.phase.data();
+        switch (c.waveform)
+        {
+        case Waveform::SINE:
+            for (size_t i = 0; i < n; i++)
+            {
+                double ph = phase[i] + t * increment[i];
+                ph -= std::floor(ph);
+                values[i] = offset[i] + amplitude[i] * std::sin(TWO_PI * ph);
+            }
+            break;
+        case Waveform::RAMP:
+            for (size_t i = 0; i < n; i++)
+            {
+                double ph = phase[i] + t * increment[i];
+                ph -= std::floor(ph);
+                values[i] = offset[i] + amplitude[i] * (2 * ph - 1);
+            }
+            break;
+        case Waveform::SQUARE:
+            for (size_t i = 0; i < n; i++)
+            {
+                double ph = phase[i] + t * increment[i];
+                ph -= std::floor(ph);
+                values[i] = offset[i] + (ph < 0.5 ? amplitude[i] : -amplitude[i]);
+            }
+            break;
+        case Waveform::NOISE:
+            for (size_t i = 0; i < n; i++)
+            {
+                values[i] = offset[i] + amplitude[i] * uniform(c.random[i]);
+            }
+            break;
+        case Waveform::RANDOM_WALK:
+            for (size_t i = 0; i < n; i++)
+            {
+                double x = c.state[i] + c.step[i] * uniform(c.random[i]);
+                x = std::min(std::max(x, offset[i] - amplitude[i]), offset[i] + amplitude[i]);
+                c.state[i] = x;
+                values[i] = x;
+            }
+            break;
+        case Waveform::COUNTER:
+            for (size_t i = 0; i < n; i++)
+            {
+                values[i] = c.state[i];
+                double x = c.state[i] + c.step[i];
+                c.state[i] = x > offset[i] + amplitude[i] ? offset[i] : x;
+            }
+            break;
+        case Waveform::REPLAY:
+            for (size_t i = 0; i < n; i++)
+            {
+                const std::vector<double> &samples = *c.samples[i];
+                values[i] = samples[c.cursor[i]];
+                c.cursor[i] = c.cursor[i] + 1 < samples.size() ? c.cursor[i] + 1 : 0;
+            }
+            break;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            encode(values[i], c.format[i], c.target[i]);
+        }
+    }
+}
+
+void SignalEngine::run()
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::duration period = std::chrono::nanoseconds(1000000000LL / mRateHz);
+    Clock::time_point next = Clock::now();
+    uint64_t tick = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mCond.wait_until(lock, next, [this]
+                                 { return mFinish; }))
+            {
+                break;
+            }
+        }
+
+        evaluate(tick);
+        for (Output &out : mOutputs)
+        {
+            out.bank->write(out.runs, out.buffer.data());
+        }
+        mTicks.fetch_add(1, std::memory_order_relaxed);
+
+        // 落后超过一个节拍时跳过错过的节拍, 周期波形按跳过后的时间继续, 不会变慢
+        tick++;
+        next += period;
+        Clock::time_point now = Clock::now();
+        if (next < now)
+        {
+            uint64_t missed = static_cast<uint64_t>((now - next) / period);
+            mOverruns.fetch_add(missed, std::memory_order_relaxed);
+            tick += missed;
+            next += period * missed;
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef SIGNALENGINE_H
+#define SIGNALENGINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "registerbank.h"
+
+// 信号发生器: 把寄存器绑定到波形上, 由固定频率的节拍线程统一计算并写入寄存器组,
+// 用来给历史库/SCADA做负载测试. 启动时把信号按波形分组, 参数按列连续存放,
+// 每个节拍对一整列做同一种计算(循环里没有分支, 编译器可以向量化);
+// 计算结果按地址排好, 每个寄存器组每个节拍只做一次批量写入, 同一节拍的所有值对读者同时生效.
+class SignalEngine
+{
+public:
+    enum class Waveform : uint8_t
+    {
+        SINE,
+        RAMP,
+        SQUARE,
+        RANDOM_WALK,
+        NOISE,
+        COUNTER,
+        REPLAY
+    };
+
+    enum class Format : uint8_t
+    {
+        UINT16,
+        INT16,
+        // 占两个寄存器, 高字在前
+        FLOAT32
+    };
+
+    // 周期波形的值为 offset + amplitude * f(t), f在[-1, 1]之间;
+    // 噪声在offset上下amplitude内均匀分布; 随机游走每个节拍移动不超过step, 限制在offset±amplitude内;
+    // 计数器从offset开始每个节拍加step, 超过offset + amplitude后回到offset;
+    // 回放每个节拍取samples中的下一个值, 循环播放
+    struct Signal
+    {
+        Waveform waveform = Waveform::SINE;
+        Format format = Format::UINT16;
+        int addr = 0;
+        double offset = 0;
+        double amplitude = 1000;
+        double periodMs = 1000;
+        // 初相, 以周期为单位, 0~1
+        double phase = 0;
+        double step = 1;
+        std::vector<double> samples;
+    };
+
+    static constexpr int DEFAULT_RATE_HZ = 1000;
+
+    explicit SignalEngine(int rateHz = DEFAULT_RATE_HZ);
+    ~SignalEngine();
+
+    SignalEngine(const SignalEngine &) = delete;
+    SignalEngine &operator=(const SignalEngine &) = delete;
+
+    // 需在start之前调用; 返回信号序号, 寄存器未映射或参数非法返回-1
+    int addSignal(const std::shared_ptr<RegisterBank> &bank, const Signal &signal);
+    size_t signalCount() const { return mSignals.size(); }
+
+    // 读取CSV中的一列作为回放数据, column从0开始, 无法解析的行(如表头)跳过
+    static bool loadCsv(const std::string &path, int column, std::vector<double> &samples);
+
+    // 同一寄存器组中的信号地址重叠时返回false
+    bool start();
+    void stop();
+    bool running() const { return mThread != nullptr; }
+
+    uint64_t ticks() const { return mTicks; }
+    // 计算来不及而跳过的节拍数
+    uint64_t overruns() const { return mOverruns; }
+
+private:
+    struct Binding
+    {
+        std::shared_ptr<RegisterBank> bank;
+        Signal signal;
+    };
+
+    // 同一种波形的所有信号, 参数按列存放
+    struct Column
+    {
+        Waveform waveform;
+        std::vector<double> offset;
+        std::vector<double> amplitude;
+        std::vector<double> step;
+        // 周期波形: 每个节拍前进的周期数和初相; 随机游走/计数器: 当前值
+        std::vector<double> increment;
+        std::vector<double> phase;
+        std::vector<double> state;
+        std::vector<uint32_t> random;
+        // 本节拍计算结果
+        std::vector<double> values;
+        // 回放数据和播放位置
+        std::vector<const std::vector<double> *> samples;
+        std::vector<size_t> cursor;
+        // 每个值写到哪个输出缓冲区的哪个位置, 以及编码方式
+        std::vector<uint16_t *> target;
+        std::vector<Format> format;
+    };
+
+    // 一个寄存器组在每个节拍的批量写入
+    struct Output
+    {
+        std::shared_ptr<RegisterBank> bank;
+        std::vector<RegisterBank::Run> runs;
+        std::vector<uint16_t> buffer;
+    };
+
+    int mRateHz;
+    std::vector<Binding> mSignals;
+    std::vector<Column> mColumns;
+    std::vector<Output> mOutputs;
+
+    std::unique_ptr<std::thread> mThread;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    bool mFinish = false;
+    std::atomic<uint64_t> mTicks{0};
+    std::atomic<uint64_t> mOverruns{0};
+
+private:
+    bool compile();
+    void evaluate(uint64_t tick);
+    void run();
+};
+
+#endif // SIGNALENGINE_H
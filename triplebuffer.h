@@ -0,0 +1,42 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// 单生产者/单消费者的无锁三缓冲: 生产者总是写后台缓冲区, 发布时与中间缓冲区交换;
+// 消费者只取最新发布的一份, 中间被覆盖的旧数据直接丢弃. 双方都不会等待对方.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // 生产者线程使用
+    T &back() { return mBuffers[mBack]; }
+    void publish()
+    {
+        mBack = mMiddle.exchange(mBack | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // 消费者线程使用: 有新数据时切换到最新一份并返回true
+    bool update()
+    {
+        if (!(mMiddle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+        mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+    const T &front() const { return mBuffers[mFront]; }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    T mBuffers[3];
+    uint8_t mBack = 0;
+    std::atomic<uint8_t> mMiddle{1};
+    uint8_t mFront = 2;
+};
+
+#endif // TRIPLEBUFFER_H